@@ -0,0 +1,243 @@
+/****************************************************************************
+ * Copyright 2017 by Thomas E. Dickey                                       *
+ *                                                                          *
+ * Permission is hereby granted, free of charge, to any person obtaining a  *
+ * copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including      *
+ * without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute, distribute with modifications, sublicense, and/or sell       *
+ * copies of the Software, and to permit persons to whom the Software is    *
+ * furnished to do so, subject to the following conditions:                 *
+ *                                                                          *
+ * This is a supporting work for discussion of the ncurses and slang        *
+ * libraries, consequently the permission notice requires this URL to be    *
+ * included:                                                                *
+ *      https://invisible-island.net/ncurses/ncurses-slang.html             *
+ *                                                                          *
+ * The above copyright notice and this permission notice shall be included  *
+ * in all copies or substantial portions of the Software.                   *
+ *                                                                          *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  *
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF               *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.   *
+ * IN NO EVENT SHALL THE ABOVE COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR    *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR    *
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.                               *
+ *                                                                          *
+ * Except as contained in this notice, the name(s) of the above copyright   *
+ * holders shall not be used in advertising or otherwise to promote the     *
+ * sale, use or other dealings in this Software without prior written       *
+ * authorization.                                                           *
+ ****************************************************************************/
+/*
+ * $Id$
+ *
+ * Helpers for running the demos as benchmarks:
+ * a) a monotonic clock,
+ * b) a cheap, repeatable random-number generator,
+ * c) a list of timings, from which percentiles are computed, and
+ * d) a pseudo-terminal to write to, so that no real terminal is needed.
+ *    A child process reads (and counts) whatever is written to it.
+ */
+
+#ifndef __BENCH_PRIV_H
+#define __BENCH_PRIV_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+typedef struct {
+    double *times;		/* timings, in seconds */
+    size_t used;
+    size_t size;
+    size_t sorted;		/* number of timings last sorted */
+    int saved_in;		/* original stdin/stdout, when using a pty */
+    int saved_out;
+    int counted;		/* pipe from the child, giving its byte-count */
+    pid_t child;
+} BENCH;
+
+static double
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+/*
+ * Use a xorshift generator rather than rand(), to keep the cost of the
+ * benchmark's own work small compared to the library calls.
+ */
+static uint32_t bench_state;
+
+static void
+bench_srand(unsigned value)
+{
+    bench_state = (uint32_t) (value ? value : 0x2545f491);
+}
+
+/* returns a number in [0,1) */
+static double
+bench_ranf(void)
+{
+    uint32_t x = bench_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    bench_state = x;
+    return ((double) (x >> 8) / 16777216.);
+}
+
+static void
+bench_reset(BENCH * b)
+{
+    b->used = 0;
+    b->sorted = 0;
+}
+
+static void
+bench_time(BENCH * b, double elapsed)
+{
+    if (b->used >= b->size) {
+	b->size = b->size ? (b->size * 2) : 1024;
+	b->times = realloc(b->times, b->size * sizeof(double));
+	if (b->times == 0) {
+	    fprintf(stderr, "cannot allocate timings\n");
+	    exit(EXIT_FAILURE);
+	}
+    }
+    b->times[b->used++] = elapsed;
+}
+
+static int
+bench_compare(const void *a, const void *b)
+{
+    double p = *(const double *) a;
+    double q = *(const double *) b;
+    return (p < q) ? -1 : (p > q);
+}
+
+/*
+ * Return the given percentile of the timings.  The list is sorted on the
+ * first call after it is changed.
+ */
+static double
+bench_percentile(BENCH * b, double percent)
+{
+    size_t n;
+
+    if (b->used == 0)
+	return 0.0;
+    if (b->sorted != b->used) {
+	qsort(b->times, b->used, sizeof(double), bench_compare);
+	b->sorted = b->used;
+    }
+    n = (size_t) ((percent / 100.0) * (double) (b->used - 1) + 0.5);
+    return b->times[n];
+}
+
+/*
+ * Make a pseudo-terminal of the given size the standard input and output.
+ * A child process reads everything written to it.
+ */
+static int
+bench_open_pty(BENCH * b, int lines, int cols)
+{
+    struct winsize ws;
+    char *name;
+    int master;
+    int slave;
+    int fds[2];
+
+    if ((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0
+	|| grantpt(master) < 0
+	|| unlockpt(master) < 0
+	|| (name = ptsname(master)) == 0
+	|| (slave = open(name, O_RDWR | O_NOCTTY)) < 0) {
+	return -1;
+    }
+    if (pipe(fds) < 0) {
+	close(slave);
+	close(master);
+	return -1;
+    }
+
+    memset(&ws, 0, sizeof(ws));
+    ws.ws_row = (unsigned short) lines;
+    ws.ws_col = (unsigned short) cols;
+    ioctl(slave, TIOCSWINSZ, &ws);
+
+    fflush(stdout);
+    if ((b->child = fork()) == 0) {
+	char buffer[BUFSIZ];
+	unsigned long total = 0;
+	ssize_t got;
+
+	signal(SIGINT, SIG_IGN);	/* let the parent finish and report */
+	signal(SIGQUIT, SIG_IGN);
+	close(slave);
+	close(fds[0]);
+	while ((got = read(master, buffer, sizeof(buffer))) > 0)
+	    total += (unsigned long) got;
+	if (write(fds[1], &total, sizeof(total)) < 0)
+	    _exit(EXIT_FAILURE);
+	_exit(EXIT_SUCCESS);
+    } else if (b->child < 0) {
+	close(slave);
+	close(master);
+	close(fds[0]);
+	close(fds[1]);
+	return -1;
+    }
+    close(master);
+    close(fds[1]);
+    b->counted = fds[0];
+
+    if (getenv("TERM") == 0)
+	setenv("TERM", "xterm", 1);
+    b->saved_in = dup(0);
+    b->saved_out = dup(1);
+    dup2(slave, 0);
+    dup2(slave, 1);
+    close(slave);
+    return 0;
+}
+
+/*
+ * Restore the standard input and output, returning the number of bytes which
+ * were written to the pseudo-terminal.
+ */
+static unsigned long
+bench_close_pty(BENCH * b)
+{
+    unsigned long total = 0;
+
+    if (b->child > 0) {
+	fflush(stdout);
+	dup2(b->saved_in, 0);
+	dup2(b->saved_out, 1);
+	close(b->saved_in);
+	close(b->saved_out);
+	if (read(b->counted, &total, sizeof(total)) != sizeof(total))
+	    total = 0;
+	close(b->counted);
+	waitpid(b->child, (int *) 0, 0);
+	b->child = 0;
+    }
+    return total;
+}
+
+#endif /* __BENCH_PRIV_H */
@@ -32,27 +32,95 @@
  * $Id: dots_slcurses.c,v 1.3 2017/03/21 00:40:10 tom Exp $
  *
  * A simple demo of the curses interface used for comparison with termcap.
+ *
+ * Given a seed, and a count or time-limit, it also serves as a benchmark of
+ * refresh, reporting the rate, bytes written and latency of each refresh.
+ * With "-p", it writes to a pseudo-terminal rather than the real terminal.
+ *
+ * Normally it refreshes after each character.  Refreshing after a number of
+ * characters, or at a given frame-rate, shows how well the screen-updates
+ * for many scattered cells are combined.
  */
+#define _XOPEN_SOURCE 600	/* for posix_openpt, etc. */
+
 #include <slcurses.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <slstats.h>
+#include <bench.priv.h>
+
 #define valid(s) ((s != 0) && s != (char *)-1)
 
 static bool interrupted = FALSE;
 static long total_chars = 0;
-static time_t started;
+static double started;
+
+static BENCH bench;
+static bool benchmark = FALSE;
+static bool use_pty = FALSE;
+static unsigned seed;
+static long max_chars = 0;
+static double max_time = 0.0;
+
+static long refresh_every = 1;	/* refresh after this many characters */
+static double frame_time = 0.0;	/* ...or after this many seconds */
+static long refreshes = 0;
+static long total_cells = 0;	/* distinct cells written between refreshes */
+
+static char *dirty;		/* cells written since the last refresh */
+static int *touched;		/* ...and a list of those, to clear them */
+static int num_touched;
+
+static bool use_colors;		/* has_colors(), which does not change */
+static int *pair_table;		/* mypair() for each fg/bg combination */
+static int current_pair = -1;
+static bool reversed = FALSE;
 
 static void
 cleanup(void)
 {
+    double elapsed;
+    unsigned long bytes = SLtt_Num_Chars_Output;
+
     endwin();
+    elapsed = bench_now() - started;
+    if (use_pty)
+	bytes = bench_close_pty(&bench);
 
     printf("\n\n%ld total chars, rate %.2f/sec\n",
 	   total_chars,
-	   ((double) (total_chars) / (double) (time((time_t *) 0) - started)));
+	   ((double) (total_chars) / elapsed));
+    if (benchmark) {
+	printf("dots_slcurses seed=%u chars=%ld elapsed=%.6f rate=%.2f"
+	       " bytes=%lu bytes_per_char=%.2f"
+	       " p50_us=%.1f p90_us=%.1f p99_us=%.1f max_us=%.1f\n",
+	       seed,
+	       total_chars,
+	       elapsed,
+	       (double) total_chars / elapsed,
+	       bytes,
+	       (double) bytes / (double) (total_chars ? total_chars : 1),
+	       bench_percentile(&bench, 50.0) * 1e6,
+	       bench_percentile(&bench, 90.0) * 1e6,
+	       bench_percentile(&bench, 99.0) * 1e6,
+	       bench_percentile(&bench, 100.0) * 1e6);
+	printf("dots_slcurses every=%ld fps=%.1f refreshes=%ld"
+	       " chars_per_refresh=%.2f cells_per_refresh=%.2f"
+	       " bytes_per_refresh=%.1f bytes_per_cell=%.2f\n",
+	       refresh_every,
+	       frame_time > 0.0 ? 1.0 / frame_time : 0.0,
+	       refreshes,
+	       (double) total_chars / (double) (refreshes ? refreshes : 1),
+	       (double) total_cells / (double) (refreshes ? refreshes : 1),
+	       (double) bytes / (double) (refreshes ? refreshes : 1),
+	       (double) bytes / (double) (total_cells ? total_cells : 1));
+    }
+    free(dirty);
+    free(touched);
+    free(pair_table);
 }
 
 static void
@@ -61,13 +129,6 @@ onsig(int n)
     interrupted = TRUE;
 }
 
-static double
-ranf(void)
-{
-    long r = (rand() & 077777);
-    return ((double) r / 32768.);
-}
-
 static int
 mypair(int fg, int bg)
 {
@@ -75,25 +136,146 @@ mypair(int fg, int bg)
     return (pair >= COLOR_PAIRS) ? -1 : pair;
 }
 
+/*
+ * The current pair and video attributes are remembered, so that attron is
+ * called only for changes.
+ */
+static void
+set_pair(int pair)
+{
+    if (pair >= 0 && pair != current_pair) {
+	attron(COLOR_PAIR(pair));
+	current_pair = pair;
+    }
+}
+
+static void
+set_reverse(bool flag)
+{
+    if (flag != reversed) {
+	if (flag) {
+	    attron(A_REVERSE);
+	} else {
+	    attroff(A_REVERSE);
+	}
+	reversed = flag;
+    }
+}
+
+/*
+ * Remember the distinct cells which are written between refreshes.
+ */
 static void
-set_colors(int fg, int bg)
+mark_cell(int y, int x)
 {
-    int pair = mypair(fg, bg);
-    if (pair > 0) {
-	attron(COLOR_PAIR(mypair(fg, bg)));
+    int n = (y * COLS) + x;
+
+    if (!dirty[n]) {
+	dirty[n] = 1;
+	touched[num_touched++] = n;
     }
 }
 
+static void
+do_refresh(void)
+{
+    double before = bench_now();
+
+    refresh();
+    if (benchmark)
+	bench_time(&bench, bench_now() - before);
+
+    ++refreshes;
+    total_cells += num_touched;
+    while (num_touched > 0)
+	dirty[touched[--num_touched]] = 0;
+}
+
+static bool
+finished(void)
+{
+    if (interrupted)
+	return TRUE;
+    if (max_chars > 0 && total_chars >= max_chars)
+	return TRUE;
+    if (max_time > 0.0 && (bench_now() - started) >= max_time)
+	return TRUE;
+    return FALSE;
+}
+
+static void
+usage(void)
+{
+    static const char *msg[] =
+    {
+	"Usage: dots_slcurses [options]"
+	,""
+	,"Options:"
+	," -f fps    refresh at this frame-rate rather than after each character"
+	," -n count  stop after writing this many characters"
+	," -p        write to a pseudo-terminal rather than the terminal"
+	," -r count  refresh after this many characters (default: 1)"
+	," -s seed   seed the random-number generator (default: time)"
+	," -t secs   stop after this many seconds"
+	,""
+	,"Any of these options also prints a summary of the benchmark."
+    };
+    size_t n;
+    for (n = 0; n < sizeof(msg) / sizeof(msg[0]); n++)
+	fprintf(stderr, "%s\n", msg[n]);
+    exit(EXIT_FAILURE);
+}
+
 int
 main(int argc,
      char *argv[])
 {
     int x, y, z, p;
     int fg, bg;
+    int ch;
     double r;
     double c;
+    double next_frame;
 
-    srand((unsigned) time(0));
+    seed = (unsigned) time(0);
+    while ((ch = getopt(argc, argv, "f:n:pr:s:t:")) != -1) {
+	switch (ch) {
+	case 'f':
+	    if (atof(optarg) <= 0.0)
+		usage();
+	    frame_time = 1.0 / atof(optarg);
+	    break;
+	case 'n':
+	    max_chars = atol(optarg);
+	    break;
+	case 'p':
+	    use_pty = TRUE;
+	    break;
+	case 'r':
+	    if ((refresh_every = atol(optarg)) < 1)
+		usage();
+	    break;
+	case 's':
+	    seed = (unsigned) strtoul(optarg, (char **) 0, 0);
+	    break;
+	case 't':
+	    max_time = atof(optarg);
+	    break;
+	default:
+	    usage();
+	    /* NOTREACHED */
+	}
+	benchmark = TRUE;
+    }
+    if (optind < argc)
+	usage();
+
+    bench_srand(seed);
+
+    if (use_pty && bench_open_pty(&bench, 24, 80) < 0) {
+	perror("pseudo-terminal");
+	exit(EXIT_FAILURE);
+    }
 
     initscr();
 
@@ -101,52 +283,80 @@ main(int argc,
     signal(SIGQUIT, onsig);
     signal(SIGTERM, onsig);
 
-    if (has_colors()) {
+    if ((use_colors = has_colors())) {
 	start_color();
+	pair_table = calloc((size_t) (COLORS * COLORS), sizeof(int));
+	if (pair_table == 0) {
+	    endwin();
+	    fprintf(stderr, "cannot allocate color-pairs\n");
+	    exit(EXIT_FAILURE);
+	}
 	for (fg = 0; fg < COLORS; fg++) {
 	    for (bg = 0; bg < COLORS; bg++) {
 		int pair = mypair(fg, bg);
 		if (pair > 0)
 		    init_pair((short) pair, (short) fg, (short) bg);
+		pair_table[(fg * COLORS) + bg] = pair;
 	    }
 	}
     }
 
+    dirty = calloc((size_t) (LINES * COLS), sizeof(char));
+    touched = calloc((size_t) (LINES * COLS), sizeof(int));
+    if (dirty == 0 || touched == 0) {
+	endwin();
+	fprintf(stderr, "cannot allocate cell-map\n");
+	exit(EXIT_FAILURE);
+    }
+
     r = (double) (LINES - 4);
     c = (double) (COLS - 4);
-    started = time((time_t *) 0);
+    started = bench_now();
+    next_frame = started + frame_time;
 
     fg = COLOR_WHITE;
     bg = COLOR_BLACK;
-    while (!interrupted) {
-	x = (int) (c * ranf()) + 2;
-	y = (int) (r * ranf()) + 2;
-	p = (ranf() > 0.9) ? '*' : ' ';
+    while (!finished()) {
+	x = (int) (c * bench_ranf()) + 2;
+	y = (int) (r * bench_ranf()) + 2;
+	p = (bench_ranf() > 0.9) ? '*' : ' ';
 
 	move(y, x);
-	if (has_colors()) {
-	    z = (int) (ranf() * COLORS);
-	    if (ranf() > 0.01) {
-		set_colors(fg = z, bg);
-		attron(COLOR_PAIR(mypair(fg, bg)));
+	if (use_colors) {
+	    z = (int) (bench_ranf() * COLORS);
+	    if (bench_ranf() > 0.01) {
+		fg = z;
+		set_pair(pair_table[(fg * COLORS) + bg]);
 	    } else {
-		set_colors(fg, bg = z);
+		bg = z;
+		if (pair_table[(fg * COLORS) + bg] > 0)
+		    set_pair(pair_table[(fg * COLORS) + bg]);
 		napms(1);
 	    }
 	} else {
-	    if (ranf() <= 0.01) {
-		if (ranf() > 0.6) {
-		    attron(A_REVERSE);
-		} else {
-		    attroff(A_REVERSE);
-		}
+	    if (bench_ranf() <= 0.01) {
+		set_reverse(bench_ranf() > 0.6);
 		napms(1);
 	    }
 	}
 	addch((chtype) p);
-	refresh();
+	mark_cell(y, x);
 	++total_chars;
+
+	if (frame_time > 0.0) {
+	    double now = bench_now();
+	    if (now >= next_frame) {
+		do_refresh();
+		next_frame += frame_time;
+		if (next_frame < now)	/* do not try to catch up */
+		    next_frame = now + frame_time;
+	    }
+	} else if (num_touched > 0 && (total_chars % refresh_every) == 0) {
+	    do_refresh();
+	}
     }
+    if (num_touched > 0)
+	do_refresh();
     cleanup();
     exit(EXIT_SUCCESS);
 }
@@ -38,6 +38,8 @@
 #define endwin() done_display()
 
 #include <picsmap.h>
+#include <slstats.h>
+#include <time.h>
 
 static int save_d_opt;
 
@@ -48,9 +50,271 @@ done_display(void)
 
 #include <picsmap.c>
 
+/*
+ * Color objects are cached by the RGB values used in the pictures, so that a
+ * color is registered with slang only once, and reused for later pictures.
+ * They are set from the numeric values, rather than having slang parse a
+ * color name.
+ * If the colors of a picture which are not yet registered would not fit in the
+ * remaining color objects, the cache is emptied first and they are registered
+ * again.  A picture with more colors than slang allows uses the nearest
+ * registered color for the others, since flushing partway would reuse objects
+ * which it already uses.
+ */
+#define MAX_OBJECTS	0x7fff	/* slang's limit on color objects */
+#define CACHE_SIZE	0x10000	/* power of two, more than MAX_OBJECTS */
+#define DEFAULT_OBJECT	(MAX_OBJECTS - 1)	/* used to make default_brush */
+
+typedef struct {
+    int rgb;			/* the color used in the picture */
+    SLsmg_Color_Type obj;	/* its color object, or zero if unused */
+} COLOR_CACHE;
+
+static COLOR_CACHE *color_cache;
+static int *object_rgb;		/* the color of each registered object */
+static int next_object = 1;
+static SLsmg_Color_Type *pic_objects;	/* color object per palette entry */
+static int pic_colors;
+static SLtt_Char_Type default_brush;	/* default foreground/background */
+static int need_touch = TRUE;	/* color objects were reused */
+
+static void
+set_object(SLsmg_Color_Type obj, int rgb)
+{
+    SLtt_Char_Type my_color = (SLtt_Char_Type) map_color(rgb);
+
+    if ((long) my_color < 0) {
+	if (save_d_opt) {
+	    debugmsg("color %3u -> default", obj);
+	    SLtt_set_color_object(obj, default_brush);
+	    return;
+	}
+	my_color = 0;
+    }
+    debugmsg("color %3u -> %06lX", obj, my_color);
+    SLtt_set_color_fgbg(obj, my_color, my_color);
+}
+
+static void
+flush_colors(void)
+{
+    logmsg("...flushing %d color objects", next_object - 1);
+    memset(color_cache, 0, CACHE_SIZE * sizeof(COLOR_CACHE));
+    next_object = 1;
+    need_touch = TRUE;
+}
+
+/*
+ * Return the cache entry for the color, or the empty entry where it would be
+ * added.
+ */
+static COLOR_CACHE *
+find_slot(int rgb)
+{
+    unsigned hash = ((unsigned) rgb * 2654435761U) >> 16;
+    COLOR_CACHE *p;
+
+    for (;; ++hash) {
+	p = &color_cache[hash & (CACHE_SIZE - 1)];
+	if (p->obj == 0 || p->rgb == rgb)
+	    break;
+    }
+    return p;
+}
+
+static SLsmg_Color_Type
+find_color(int rgb, int *added)
+{
+    COLOR_CACHE *p = find_slot(rgb);
+
+    if (p->obj != 0)
+	return p->obj;
+    if (next_object >= DEFAULT_OBJECT)
+	return 0;		/* no room, use near_color */
+    p->rgb = rgb;
+    p->obj = (SLsmg_Color_Type) next_object++;
+    object_rgb[p->obj] = rgb;
+    set_object(p->obj, rgb);
+    ++(*added);
+    return p->obj;
+}
+
+/*
+ * Find the registered color nearest to the given one.  The result is kept for
+ * each cell of a coarse grid of colors, to limit the searches.
+ */
+#define NEAR_BITS	4
+#define NEAR_SIZE	(1 << (3 * NEAR_BITS))
+#define NEAR_KEY(rgb)	((((rgb) >> (24 - NEAR_BITS)) & 0xf00) \
+			| (((rgb) >> (16 - NEAR_BITS)) & 0x0f0) \
+			| (((rgb) >> (8 - NEAR_BITS)) & 0x00f))
+
+static SLsmg_Color_Type near_objects[NEAR_SIZE];
+
+static SLsmg_Color_Type
+near_color(int rgb)
+{
+    SLsmg_Color_Type *slot = &near_objects[NEAR_KEY(rgb)];
+
+    if (*slot == 0) {
+	long best = -1;
+	int n;
+
+	for (n = 1; n < next_object; ++n) {
+	    int other = object_rgb[n];
+	    long dr = ((rgb >> 16) & 0xff) - ((other >> 16) & 0xff);
+	    long dg = ((rgb >> 8) & 0xff) - ((other >> 8) & 0xff);
+	    long db = (rgb & 0xff) - (other & 0xff);
+	    long dist = (dr * dr) + (dg * dg) + (db * db);
+
+	    if (best < 0 || dist < best) {
+		best = dist;
+		*slot = (SLsmg_Color_Type) n;
+	    }
+	}
+    }
+    return *slot;
+}
+
+/*
+ * Find the color objects for the picture's palette, registering any which
+ * are not already known.
+ */
+static void
+map_palette(PICS_HEAD * pics)
+{
+    int added = 0;
+    int missing = 0;
+    int n;
+
+    if (color_cache == 0) {
+	color_cache = typeCalloc(COLOR_CACHE, CACHE_SIZE);
+	object_rgb = typeCalloc(int, MAX_OBJECTS);
+	if (color_cache == 0 || object_rgb == 0)
+	    SLang_exit_error("cannot allocate color cache");
+	/*
+	 * slang has no numeric value for the default colors, but a color
+	 * object which uses them can be copied.
+	 */
+	if (save_d_opt) {
+	    SLtt_set_color(DEFAULT_OBJECT, NULL, "default", "default");
+	    default_brush = SLtt_get_color_object(DEFAULT_OBJECT);
+	}
+    }
+    if (pic_colors < pics->colors) {
+	pic_colors = pics->colors;
+	pic_objects = typeRealloc(SLsmg_Color_Type, pic_colors, pic_objects);
+	if (pic_objects == 0)
+	    SLang_exit_error("cannot allocate color objects");
+    }
+    /* find the colors which are already registered, counting the others */
+    for (n = 0; n < pics->colors; ++n) {
+	if ((pic_objects[n] = find_slot(fg_color(pics, n))->obj) == 0)
+	    ++missing;
+    }
+    /* never flush the cache while mapping a picture, only before */
+    if (missing != 0 && next_object + missing > DEFAULT_OBJECT) {
+	flush_colors();
+	memset(pic_objects, 0, (size_t) pics->colors * sizeof(SLsmg_Color_Type));
+    }
+    for (n = 0; n < pics->colors; ++n) {
+	if (pic_objects[n] == 0)
+	    pic_objects[n] = find_color(fg_color(pics, n), &added);
+    }
+    if (next_object >= DEFAULT_OBJECT) {
+	int nearest = 0;
+
+	memset(near_objects, 0, sizeof(near_objects));
+	for (n = 0; n < pics->colors; ++n) {
+	    if (pic_objects[n] == 0) {
+		pic_objects[n] = near_color(fg_color(pics, n));
+		++nearest;
+	    }
+	}
+	logmsg("...%d colors use the nearest color object", nearest);
+    }
+    logmsg("...using %d colors (%d new)", pics->colors, added);
+}
+
+/*
+ * Write a row of cells, grouping runs of the same color so that the color is
+ * set once per run, and the run's characters are written with one call.
+ */
+static void
+blit_row(const PICS_CELL * cells, int count, int colored)
+{
+    static SLuchar_Type *buffer;
+    static int length;
+    int utf8 = SLsmg_is_utf8_mode();
+    int x = 0;
+
+    if (length < (count * SLUTF8_MAX_MBLEN) + 1) {
+	length = (count * SLUTF8_MAX_MBLEN) + 1;
+	buffer = typeRealloc(SLuchar_Type, length, buffer);
+	if (buffer == 0)
+	    SLang_exit_error("cannot allocate row buffer");
+    }
+    while (x < count) {
+	int fg = cells[x].fg;
+	SLuchar_Type *s = buffer;
+
+	do {
+	    SLwchar_Type ch = (SLwchar_Type) cells[x].ch;
+	    if (ch < 128 || !utf8) {
+		*s++ = (SLuchar_Type) ch;
+	    } else if ((s = SLutf8_encode(ch, s, SLUTF8_MAX_MBLEN)) == 0) {
+		s = buffer;	/* should not happen */
+	    }
+	} while (++x < count && cells[x].fg == fg);
+
+	SLsmg_set_color(colored ? pic_objects[fg] : 0);
+	SLsmg_write_chars(buffer, s);
+    }
+}
+
+static double
+time_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+/*
+ * Pictures are shown for slow_time seconds, but rather than sleeping after
+ * showing a picture, remember when it may be replaced, and return so that
+ * the next picture is loaded meanwhile.  The next picture is drawn on the
+ * virtual screen, and shown when the time is up.
+ */
+static double show_until;	/* when the current picture may be replaced */
+
+static void
+wait_until(double deadline)
+{
+    double wait;
+
+    while ((wait = deadline - time_now()) > 0.0) {
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) wait;
+	ts.tv_nsec = (long) ((wait - (double) ts.tv_sec) * 1e9);
+	nanosleep(&ts, (struct timespec *) 0);
+    }
+}
+
+/* show the last picture for the full time, too */
+static void
+wait_last_picture(void)
+{
+    wait_until(show_until);
+}
+
+/* on an error, exit without waiting to show the last picture */
 static void
 exit_error_hook(char *fmt, va_list ap)
 {
+    show_until = 0.0;
     SLang_reset_tty();
     SLsmg_reset_smg();
 
@@ -59,6 +323,220 @@ exit_error_hook(char *fmt, va_list ap)
     exit(EXIT_FAILURE);
 }
 
+/*
+ * The previous picture is kept, so that rows which have not changed need not
+ * be drawn again.  slang's refresh sends only the cells which differ from the
+ * screen, so the screen is touched only when color objects are reused.
+ */
+static PICS_CELL *last_cells;	/* the cells of the previous picture */
+static size_t last_size;
+static int last_high = -1;	/* ...or -1 if it is not on the screen */
+static int last_wide;
+static int last_colors;
+static SLsmg_Color_Type *last_objects;
+
+static int
+same_frame(PICS_HEAD * pics, int colored)
+{
+    return (!need_touch
+	    && last_high == pics->high
+	    && last_wide == pics->wide
+	    && last_colors == (colored ? pics->colors : 0)
+	    && (!colored
+		|| !memcmp(last_objects, pic_objects,
+			   (size_t) pics->colors * sizeof(SLsmg_Color_Type))));
+}
+
+static void
+save_frame(PICS_HEAD * pics, int colored)
+{
+    size_t cells = (size_t) pics->high * (size_t) pics->wide;
+
+    if (last_size < cells) {
+	last_size = cells;
+	last_cells = typeRealloc(PICS_CELL, last_size, last_cells);
+	if (last_cells == 0)
+	    SLang_exit_error("cannot allocate frame");
+    }
+    memcpy(last_cells, pics->cells, cells * sizeof(PICS_CELL));
+    last_colors = colored ? pics->colors : 0;
+    if (last_colors) {
+	last_objects = typeRealloc(SLsmg_Color_Type, last_colors, last_objects);
+	if (last_objects == 0)
+	    SLang_exit_error("cannot allocate frame");
+	memcpy(last_objects, pic_objects,
+	       (size_t) last_colors * sizeof(SLsmg_Color_Type));
+    }
+    last_high = pics->high;
+    last_wide = pics->wide;
+}
+
+/*
+ * Draw the part of the picture which fits on the screen, starting at the
+ * given row and column of the picture.  Each line is cleared to the right
+ * of the picture, rather than clearing the whole screen first, so that
+ * slang's refresh sees only the cells which actually change.  If "same" is
+ * given, it holds the cells already drawn, and rows which match are skipped.
+ * Returns the number of cells drawn.
+ */
+static int
+draw_picture(PICS_HEAD * pics, int top, int left, int colored,
+	     const PICS_CELL * same)
+{
+    int wide = pics->wide - left;
+    int drawn = 0;
+    int y;
+
+    if (wide > COLS)
+	wide = COLS;
+    for (y = 0; y < LINES; ++y) {
+	int offset = ((top + y) * pics->wide) + left;
+
+	if (same != 0
+	    && top + y < pics->high
+	    && !memcmp(pics->cells + offset,
+		       same + offset,
+		       (size_t) wide * sizeof(PICS_CELL))) {
+	    continue;
+	}
+	SLsmg_gotorc(y, 0);
+	if (top + y < pics->high && wide > 0) {
+	    blit_row(pics->cells + offset, wide, colored);
+	    drawn += wide;
+	}
+	SLsmg_set_color(colored ? pic_objects[0] : 0);
+	SLsmg_erase_eol();
+    }
+    return drawn;
+}
+
+/*
+ * Move the viewport by the given amounts, within the limits of the picture.
+ * Returns true if it moved.
+ */
+static int
+pan_picture(PICS_HEAD * pics, int *top, int *left, int dy, int dx)
+{
+    int old_top = *top;
+    int old_left = *left;
+    int max_top = pics->high - LINES;
+    int max_left = pics->wide - COLS;
+
+    *top += dy;
+    *left += dx;
+    if (*top > max_top)
+	*top = max_top;
+    if (*top < 0)
+	*top = 0;
+    if (*left > max_left)
+	*left = max_left;
+    if (*left < 0)
+	*left = 0;
+    return (*top != old_top || *left != old_left);
+}
+
+/*
+ * Show the picture until a key other than those used for panning is read.
+ */
+static void
+view_picture(PICS_HEAD * pics, int colored)
+{
+    int top = 0;
+    int left = 0;
+    int done = FALSE;
+
+    while (!done) {
+	int dy = 0;
+	int dx = 0;
+
+	SLsmg_gotorc(0, 0);
+	SLsmg_refresh();
+	switch (SLkp_getkey()) {
+	case SL_KEY_UP:
+	    dy = -1;
+	    break;
+	case SL_KEY_DOWN:
+	    dy = 1;
+	    break;
+	case SL_KEY_LEFT:
+	    dx = -1;
+	    break;
+	case SL_KEY_RIGHT:
+	    dx = 1;
+	    break;
+	case SL_KEY_PPAGE:
+	    dy = -(LINES - 1);
+	    break;
+	case SL_KEY_NPAGE:
+	    dy = LINES - 1;
+	    break;
+	case SL_KEY_HOME:
+	    dy = -top;
+	    dx = -left;
+	    break;
+	default:
+	    done = TRUE;
+	    continue;
+	}
+	if (pan_picture(pics, &top, &left, dy, dx)) {
+	    draw_picture(pics, top, left, colored, (PICS_CELL *) 0);
+	    last_high = -1;
+	} else {
+	    SLtt_beep();
+	}
+    }
+}
+
+static void
+show_picture(PICS_HEAD * pics)
+{
+    int colored = (SLtt_Use_Ansi_Colors && pics->colors > 0);
+    int drawn;
+    double started;
+
+    debugmsg("called show_picture");
+    if (colored)
+	map_palette(pics);
+    started = time_now();
+    drawn = draw_picture(pics, 0, 0, colored,
+			 same_frame(pics, colored) ? last_cells : 0);
+    save_frame(pics, colored);
+    if (need_touch) {
+	SLsmg_touch_screen();
+	need_touch = FALSE;
+    }
+    if (drawn > 0) {
+	double elapsed = time_now() - started;
+	logmsg("...drew %d cells in %.3f msec (%.0f cells/sec)",
+	       drawn,
+	       elapsed * 1e3,
+	       (elapsed > 0.0) ? ((double) drawn / elapsed) : 0.0);
+    }
+    if (slow_time >= 0) {
+	unsigned long bytes;
+
+	if (show_until > 0.0) {
+	    double waited = show_until - time_now();
+	    if (waited > 0.0) {
+		logmsg("...waited %.3f sec to show picture", waited);
+		wait_until(show_until);
+	    }
+	}
+	bytes = SLtt_Num_Chars_Output;
+	SLsmg_refresh();
+	logmsg("...wrote %lu bytes", SLtt_Num_Chars_Output - bytes);
+	if (slow_time > 0) {
+	    if (show_until == 0.0)
+		atexit(wait_last_picture);
+	    show_until = time_now() + slow_time;
+	}
+    } else {
+	view_picture(pics, colored);
+    }
+    if (!quiet)
+	endwin();
+}
+
 void
 init_display(const char *palette_path, int d_option)
 {
@@ -115,55 +593,3 @@ init_display(const char *palette_path, int d_option)
 	done_display();
     }
 }
-
-static void
-show_picture(PICS_HEAD * pics)
-{
-    int y, x;
-    int n;
-    SLsmg_Color_Type my_pair;
-    SLtt_Char_Type my_color;
-
-    debugmsg("called show_picture");
-    SLsmg_touch_screen();
-    if (SLtt_Use_Ansi_Colors) {
-	logmsg("...using %d colors", pics->colors);
-	for (n = 0; n < pics->colors; ++n) {
-	    my_pair = (SLsmg_Color_Type) (n + 1);
-	    my_color = (SLtt_Char_Type) map_color(fg_color(pics, n));
-	    /* slang does not support default-colors with this interface */
-	    if ((long) my_color < 0) {
-		my_color = 0;
-	    }
-	    debugmsg("color %3u -> %06X", my_pair, my_color);
-	    SLtt_set_color_fgbg(my_pair, my_color, my_color);
-	}
-    }
-    SLsmg_set_color(1);
-    SLsmg_fill_region(0, 0, (unsigned) LINES, (unsigned) COLS, ' ');
-    for (y = 0; y < pics->high; ++y) {
-	if (y >= LINES)
-	    break;
-	SLsmg_gotorc(y, 0);
-	for (x = 0; x < pics->wide; ++x) {
-	    if (x >= COLS)
-		break;
-	    n = (y * pics->wide + x);
-	    my_pair = (SLsmg_Color_Type) (pics->cells[n].fg + 1);
-	    SLsmg_set_color(my_pair);
-	    SLsmg_write_char((SLwchar_Type) pics->cells[n].ch);
-	}
-    }
-    if (slow_time >= 0) {
-	SLsmg_refresh();
-	if (slow_time > 0) {
-	    sleep((unsigned) slow_time);
-	}
-    } else {
-	SLsmg_gotorc(0, 0);
-	SLsmg_refresh();
-	SLkp_getkey();
-    }
-    if (!quiet)
-	endwin();
-}
@@ -0,0 +1,282 @@
+/****************************************************************************
+ * Copyright 2017 by Thomas E. Dickey                                       *
+ *                                                                          *
+ * Permission is hereby granted, free of charge, to any person obtaining a  *
+ * copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including      *
+ * without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute, distribute with modifications, sublicense, and/or sell       *
+ * copies of the Software, and to permit persons to whom the Software is    *
+ * furnished to do so, subject to the following conditions:                 *
+ *                                                                          *
+ * This is a supporting work for discussion of the ncurses and slang        *
+ * libraries, consequently the permission notice requires this URL to be    *
+ * included:                                                                *
+ *      https://invisible-island.net/ncurses/ncurses-slang.html             *
+ *                                                                          *
+ * The above copyright notice and this permission notice shall be included  *
+ * in all copies or substantial portions of the Software.                   *
+ *                                                                          *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  *
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF               *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.   *
+ * IN NO EVENT SHALL THE ABOVE COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR    *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR    *
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.                               *
+ *                                                                          *
+ * Except as contained in this notice, the name(s) of the above copyright   *
+ * holders shall not be used in advertising or otherwise to promote the     *
+ * sale, use or other dealings in this Software without prior written       *
+ * authorization.                                                           *
+ ****************************************************************************/
+/*
+ * $Id$
+ *
+ * Optional statistics for the screen-updates made by these programs.  Include
+ * this after <slang.h> or <slcurses.h>, and set $SLSTATS to enable it:
+ *
+ *	SLSTATS=-	write a summary to the standard error on exit
+ *	SLSTATS=name	append the summary to the given file
+ *
+ * The refresh calls are wrapped to measure their time and the bytes which
+ * they write.  slang's screen-manager is given a copy of the terminal
+ * interface in which the cell-updates and flushes are counted.
+ */
+
+#ifndef __SLSTATS_H
+#define __SLSTATS_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <slang.h>
+
+#ifdef __GNUC__
+#define SLSTATS_UNUSED __attribute__((unused))
+#else
+#define SLSTATS_UNUSED		/* nothing */
+#endif
+
+typedef struct {
+    int state;			/* 0=unknown, 1=enabled, -1=disabled */
+    FILE *output;
+    unsigned long refreshes;	/* calls to SLsmg_refresh, wrefresh, doupdate */
+    unsigned long flushes;	/* calls to SLtt_flush_output */
+    unsigned long cells;	/* cells which differed from the screen */
+    unsigned long bytes;	/* bytes written during refreshes */
+    double elapsed;		/* seconds spent in refreshes */
+    double longest;		/* the slowest refresh */
+    unsigned long scrolls;	/* refreshes after scrolling, if reported */
+    unsigned long scroll_bytes;	/* bytes written by those refreshes */
+} SLSTATS;
+
+static SLSTATS slstats;
+static SLsmg_Term_Type slstats_term;
+
+static double
+slstats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + ((double) ts.tv_nsec / 1e9);
+}
+
+static int
+slstats_flush_output(void)
+{
+    slstats.flushes++;
+    return SLtt_flush_output();
+}
+
+/*
+ * slang calls this for each line which differs from the screen, passing the
+ * new and old contents.  Count the cells which actually changed.
+ */
+static void
+slstats_smart_puts(SLsmg_Char_Type * new_s,
+		   SLsmg_Char_Type * old_s,
+		   int len,
+		   int row)
+{
+    int n;
+
+    for (n = 0; n < len; ++n) {
+	if (new_s[n].color != old_s[n].color
+	    || new_s[n].nchars != old_s[n].nchars
+	    || memcmp(new_s[n].wchars,
+		      old_s[n].wchars,
+		      new_s[n].nchars * sizeof(SLwchar_Type))) {
+	    slstats.cells++;
+	}
+    }
+    SLtt_smart_puts(new_s, old_s, len, row);
+}
+
+static void
+slstats_summary(void)
+{
+    FILE *fp = slstats.output;
+    double count = (double) (slstats.refreshes ? slstats.refreshes : 1);
+
+    fprintf(fp, "slstats: %lu refreshes, %.3f sec"
+	    " (avg %.1f usec, max %.1f usec)\n",
+	    slstats.refreshes,
+	    slstats.elapsed,
+	    (slstats.elapsed * 1e6) / count,
+	    slstats.longest * 1e6);
+    fprintf(fp, "slstats: %lu bytes (%.1f per refresh), %lu total\n",
+	    slstats.bytes,
+	    (double) slstats.bytes / count,
+	    SLtt_Num_Chars_Output);
+    fprintf(fp, "slstats: %lu flushes, %lu cells changed (%.1f per refresh)\n",
+	    slstats.flushes,
+	    slstats.cells,
+	    (double) slstats.cells / count);
+    if (slstats.scrolls != 0)
+	fprintf(fp, "slstats: %lu scrolls, %lu bytes (%.1f per scroll)\n",
+		slstats.scrolls,
+		slstats.scroll_bytes,
+		(double) slstats.scroll_bytes / (double) slstats.scrolls);
+    if (fp != stderr)
+	fclose(fp);
+}
+
+static int
+slstats_enabled(void)
+{
+    if (slstats.state == 0) {
+	const char *name = getenv("SLSTATS");
+
+	slstats.state = -1;
+	if (name != 0) {
+	    if (*name == '\0' || !strcmp(name, "-")) {
+		slstats.output = stderr;
+	    } else {
+		slstats.output = fopen(name, "a");
+	    }
+	}
+	if (slstats.output != 0) {
+	    slstats_term.tt_normal_video = SLtt_normal_video;
+	    slstats_term.tt_set_scroll_region = SLtt_set_scroll_region;
+	    slstats_term.tt_goto_rc = SLtt_goto_rc;
+	    slstats_term.tt_reverse_index = SLtt_reverse_index;
+	    slstats_term.tt_reset_scroll_region = SLtt_reset_scroll_region;
+	    slstats_term.tt_delete_nlines = SLtt_delete_nlines;
+	    slstats_term.tt_cls = SLtt_cls;
+	    slstats_term.tt_del_eol = SLtt_del_eol;
+	    slstats_term.tt_smart_puts = slstats_smart_puts;
+	    slstats_term.tt_flush_output = slstats_flush_output;
+	    slstats_term.tt_reset_video = SLtt_reset_video;
+	    slstats_term.tt_init_video = SLtt_init_video;
+	    slstats_term.tt_screen_rows = &SLtt_Screen_Rows;
+	    slstats_term.tt_screen_cols = &SLtt_Screen_Cols;
+	    slstats_term.tt_term_cannot_scroll = &SLtt_Term_Cannot_Scroll;
+	    slstats_term.tt_has_alt_charset = &SLtt_Has_Alt_Charset;
+	    slstats_term.tt_use_blink_for_acs = &SLtt_Use_Blink_For_ACS;
+	    slstats_term.tt_graphic_char_pairs = &SLtt_Graphics_Char_Pairs;
+	    SLsmg_set_terminal_info(&slstats_term);
+	    atexit(slstats_summary);
+	    slstats.state = 1;
+	}
+    }
+    return (slstats.state > 0);
+}
+
+static void
+slstats_update(double started, unsigned long bytes)
+{
+    double elapsed = slstats_now() - started;
+
+    slstats.refreshes++;
+    slstats.elapsed += elapsed;
+    if (elapsed > slstats.longest)
+	slstats.longest = elapsed;
+    slstats.bytes += SLtt_Num_Chars_Output - bytes;
+}
+
+/*
+ * Programs which scroll the screen can report the bytes written by the
+ * refresh which follows.
+ */
+static SLSTATS_UNUSED void
+slstats_scrolled(unsigned long bytes)
+{
+    if (slstats_enabled()) {
+	slstats.scrolls++;
+	slstats.scroll_bytes += bytes;
+    }
+}
+
+/*
+ * Parenthesize the function names to call the functions, not the macros.
+ */
+static SLSTATS_UNUSED void
+slstats_refresh(void)
+{
+    if (slstats_enabled()) {
+	unsigned long bytes = SLtt_Num_Chars_Output;
+	double started = slstats_now();
+
+	(SLsmg_refresh) ();
+	slstats_update(started, bytes);
+    } else {
+	(SLsmg_refresh) ();
+    }
+}
+#define SLsmg_refresh() slstats_refresh()
+
+#if defined(FAKE_CURSES_H)	/* with-slcurses supplies wrefresh */
+#define SLSTATS_WREFRESH(w) wrefresh(w)
+#elif defined(wrefresh)		/* slcurses.h was included */
+#define SLSTATS_WREFRESH(w) (SLcurses_wrefresh) (w)
+#endif
+
+#ifdef SLSTATS_WREFRESH
+static SLSTATS_UNUSED int
+slstats_wrefresh(SLcurses_Window_Type * w)
+{
+    int rc;
+
+    if (slstats_enabled()) {
+	unsigned long bytes = SLtt_Num_Chars_Output;
+	double started = slstats_now();
+
+	rc = SLSTATS_WREFRESH(w);
+	slstats_update(started, bytes);
+    } else {
+	rc = SLSTATS_WREFRESH(w);
+    }
+    return rc;
+}
+#ifdef FAKE_CURSES_H
+#undef wrefresh
+#define wrefresh(w) slstats_wrefresh(w)
+
+static SLSTATS_UNUSED int
+slstats_doupdate(void)
+{
+    int rc;
+
+    if (slstats_enabled()) {
+	unsigned long bytes = SLtt_Num_Chars_Output;
+	double started = slstats_now();
+
+	rc = doupdate();
+	slstats_update(started, bytes);
+    } else {
+	rc = doupdate();
+    }
+    return rc;
+}
+#undef doupdate
+#define doupdate() slstats_doupdate()
+#else
+#define SLcurses_wrefresh(w) slstats_wrefresh(w)
+#endif
+#endif
+
+#endif /* __SLSTATS_H */
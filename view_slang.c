@@ -42,9 +42,15 @@
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <slang.h>
 #include <slcurses.h>
+#include <slstats.h>
 
 #ifdef __GNUC__
 #define GCC_NORETURN __attribute__((noreturn))
@@ -54,9 +60,25 @@
 
 static void finish(int) GCC_NORETURN;
 
+static int Stdin_Flags = -1;	/* stdin's flags before O_NONBLOCK, or -1 */
+
+/*
+ * Reading from a pipe makes stdin nonblocking.  The descriptor is shared with
+ * the process which wrote to it, so put back its flags when done.
+ */
+static void
+restore_stdin(void)
+{
+    if (Stdin_Flags != -1) {
+	(void) fcntl(fileno(stdin), F_SETFL, Stdin_Flags);
+	Stdin_Flags = -1;
+    }
+}
+
 static void
 finish(int sig)
 {
+    restore_stdin();
     SLang_reset_tty();
     SLsmg_reset_smg();
 
@@ -162,6 +184,7 @@ keyname(int c)
 static void
 exit_error_hook(char *fmt, va_list ap)
 {
+    restore_stdin();
     SLang_reset_tty();
     SLsmg_reset_smg();
 
@@ -199,99 +222,304 @@ InitializeTerminal(void)
 /* The SLscroll routines will be used for pageup/down commands.  They assume
  * a linked list of lines.  The first element of the structure MUST point to
  * the NEXT line, the second MUST point to the PREVIOUS line.
+ *
+ * The lines are allocated as one array rather than individually, and refer
+ * to the file's text by offset rather than by copying it.  The offsets remain
+ * valid if the text is moved.
  */
 typedef struct _MyData {
     struct _MyData *next;
     struct _MyData *prev;
-    char *data;			/* pointer to line data */
+    size_t offset;		/* offset of line data in Text.data */
+    size_t length;		/* length of line data, without newline */
 } MyData;
 
 /* The SLscroll routines will use this structure. */
 static SLscroll_Window_Type Line_Window;
 
-static void
-free_lines(MyData * lines)
+/* Keep the end of the list, to make SL_KEY_END independent of file-size. */
+static MyData *Last_Line;
+
+static MyData *Lines;		/* the array of lines */
+static size_t Max_Lines;	/* allocated size of Lines[] */
+
+/*
+ * The file's text is memory-mapped if it is a regular file, otherwise read
+ * into a buffer.  Lines are indexed on demand, a few at a time.
+ *
+ * Text is read from a pipe as it arrives, until end-of-file.  When following
+ * a regular file, it is remapped when it grows.
+ */
+static struct {
+    char *data;			/* the file's contents */
+    size_t length;		/* number of bytes in data[] */
+    size_t allocated;		/* allocated size of data[], if not mapped */
+    size_t scanned;		/* number of bytes indexed into Lines[] */
+    int is_file;		/* true if this is a regular file */
+    int mapped;			/* true if data[] is mmap'd */
+    int fd;			/* descriptor to read more from, or -1 */
+    int complete;		/* true if no more text will be read */
+    int pending;		/* true if there are lines to index */
+} Text;
+
+#define SCAN_LINES 10000	/* lines to index per step */
+#define READ_BYTES 0x100000	/* bytes to read from a pipe per step */
+
+#define LineIndex(p)  ((p) != NULL ? (long) ((MyData *) (p) - Lines) : -1L)
+#define LineAt(n)     ((n) >= 0 ? (SLscroll_Type *) (Lines + (n)) : NULL)
+
+/*
+ * Grow the array of lines.  If realloc moves it, repair the links, as well as
+ * the pointers which SLscroll keeps in Line_Window.
+ */
+static int
+grow_lines(void)
 {
-    MyData *line, *next;
-
-    line = lines;
-    while (line != NULL) {
-	next = line->next;
-	if (line->data != NULL)
-	    free(line->data);
-	free(line);
-	line = next;
+    size_t need = (Max_Lines != 0) ? (2 * Max_Lines) : 1024;
+    size_t num_lines = Line_Window.num_lines;
+    long top = LineIndex(Line_Window.top_window_line);
+    long bot = LineIndex(Line_Window.bot_window_line);
+    long cur = LineIndex(Line_Window.current_line);
+    MyData *moved = (MyData *) realloc(Lines, need * sizeof(MyData));
+    size_t n;
+
+    if (moved == NULL)
+	return 0;
+
+    if (moved != Lines) {
+	Lines = moved;
+	for (n = 0; n < num_lines; ++n) {
+	    Lines[n].prev = (n != 0) ? &Lines[n - 1] : NULL;
+	    Lines[n].next = (n + 1 < num_lines) ? &Lines[n + 1] : NULL;
+	}
+	Line_Window.lines = (num_lines != 0) ? LineAt(0) : NULL;
+	Line_Window.top_window_line = LineAt(top);
+	Line_Window.bot_window_line = LineAt(bot);
+	Line_Window.current_line = LineAt(cur);
+	Last_Line = (num_lines != 0) ? &Lines[num_lines - 1] : NULL;
     }
+    Max_Lines = need;
+    return 1;
 }
 
-static MyData *
-create_line(char *buf)
+static void
+add_line(size_t offset, size_t length)
 {
+    size_t num_lines = Line_Window.num_lines;
     MyData *line;
 
-    line = (MyData *) malloc(sizeof(MyData));
-    if (line == NULL)
-	return NULL;
-
-    memset((char *) line, 0, sizeof(MyData));
-
-    line->data = SLmake_string(buf);	/* use a slang routine */
-    if (line->data == NULL) {
-	free(line);
-	return NULL;
+    if ((num_lines >= Max_Lines) && !grow_lines())
+	SLang_exit_error("Out of memory.");
+
+    line = &Lines[num_lines];
+    line->offset = offset;
+    line->length = length;
+    line->next = NULL;
+    line->prev = Last_Line;
+    if (Last_Line != NULL) {
+	Last_Line->next = line;
+    } else {
+	Line_Window.lines = (SLscroll_Type *) line;
+	Line_Window.current_line = (SLscroll_Type *) line;
+	Line_Window.line_num = 1;
     }
+    Last_Line = line;
+    Line_Window.num_lines = (unsigned) (num_lines + 1);
+}
 
-    return line;
+/*
+ * Index up to "count" more lines, returning true if there is more to do.  A
+ * partial line at the end of the text is left for later, unless no more text
+ * will be read.
+ */
+static int
+scan_lines(size_t count)
+{
+    while ((count-- != 0) && (Text.scanned < Text.length)) {
+	size_t offset = Text.scanned;
+	size_t length = Text.length - offset;
+	char *s = Text.data + offset;
+	char *t = memchr(s, '\n', length);
+
+	if (t != NULL) {
+	    length = (size_t) (t - s);
+	    Text.scanned = offset + length + 1;
+	} else if (Text.complete) {
+	    Text.scanned = Text.length;
+	} else {
+	    Text.pending = 0;
+	    return 0;
+	}
+	add_line(offset, length);
+    }
+    Text.pending = (Text.scanned < Text.length);
+    return Text.pending;
 }
 
-static MyData *
-ReadFile(char *filename)
+/*
+ * Make sure that at least "count" lines are indexed, if the file has that many.
+ */
+static void
+need_lines(size_t count)
 {
-    FILE *fp;
-    char buf[1024];
-    MyData *result = NULL;
-    MyData *line, *last_line;
-    unsigned int num_lines;
+    while ((Line_Window.num_lines < count) && scan_lines(SCAN_LINES)) {
+	;
+    }
+}
 
-    if (filename == NULL)
-	fp = stdin;
+static void
+end_of_text(void)
+{
+    if (Text.fd != fileno(stdin))
+	close(Text.fd);
     else
-	fp = fopen(filename, "r");
+	restore_stdin();
+    Text.fd = -1;
+    Text.complete = 1;
+    Text.pending = (Text.scanned < Text.length);
+}
 
-    if (fp == NULL)
-	return NULL;
+/*
+ * Read whatever is available from a pipe, without waiting for more.  Returns
+ * true if anything was read.
+ */
+static int
+read_pipe(void)
+{
+    size_t limit = Text.length + READ_BYTES;
+    int found = 0;
 
-    last_line = NULL;
-    num_lines = 0;
+    while (Text.length < limit) {
+	ssize_t got;
 
-    while (NULL != fgets(buf, sizeof(buf), fp)) {
-	num_lines++;
+	if (Text.length + BUFSIZ > Text.allocated) {
+	    size_t need = (2 * Text.allocated) + BUFSIZ;
+	    char *bigger = realloc(Text.data, need);
 
-	if (NULL == (line = create_line(buf))) {
-	    fprintf(stderr, "Out of memory.");
-	    free_lines(result);
-	    return NULL;
+	    if (bigger == NULL)
+		SLang_exit_error("Out of memory.");
+	    Text.data = bigger;
+	    Text.allocated = need;
+	}
+	got = read(Text.fd, Text.data + Text.length, Text.allocated - Text.length);
+	if (got > 0) {
+	    Text.length += (size_t) got;
+	    found = 1;
+	} else if ((got < 0) && (errno == EINTR)) {
+	    continue;
+	} else {
+	    if ((got == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)))
+		end_of_text();
+	    break;
 	}
+    }
+    return found;
+}
 
-	if (last_line == NULL)
-	    result = line;
-	else
-	    last_line->next = line;
+/*
+ * Map a regular file again if it has grown.  The lines refer to the text by
+ * offset, so they are unaffected by the move.
+ */
+static int
+remap_file(void)
+{
+    struct stat sb;
+    size_t length;
+    char *data;
+
+    if ((fstat(Text.fd, &sb) != 0)
+	|| ((size_t) sb.st_size <= Text.length))
+	return 0;
+
+    length = (size_t) sb.st_size;
+    data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, Text.fd, 0);
+    if (data == MAP_FAILED)
+	return 0;
+
+    if (Text.mapped)
+	munmap(Text.data, Text.length);
+    Text.data = data;
+    Text.length = length;
+    Text.mapped = 1;
+    return 1;
+}
 
-	line->prev = last_line;
-	line->next = NULL;
+/*
+ * Check for text which has arrived since the last check.
+ */
+static int
+more_text(void)
+{
+    int found = 0;
 
-	last_line = line;
+    if (Text.fd >= 0) {
+	found = Text.is_file ? remap_file() : read_pipe();
+	if (found)
+	    Text.pending = 1;
     }
+    return found;
+}
+
+static int
+ReadFile(char *filename, int follow)
+{
+    struct stat sb;
+    int fd;
+    int rc = 0;
+
+    if (filename == NULL)
+	fd = fileno(stdin);
+    else
+	fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+	return -1;
 
     memset((char *) &Line_Window, 0, sizeof(SLscroll_Window_Type));
+    memset((char *) &Text, 0, sizeof(Text));
+    Text.fd = -1;
+
+    if (fstat(fd, &sb) != 0) {
+	rc = -1;
+	if (fd != fileno(stdin))
+	    close(fd);
+    } else if (S_ISREG(sb.st_mode)) {
+	Text.is_file = 1;
+	Text.length = (size_t) sb.st_size;
+	if (Text.length != 0) {
+	    Text.data = mmap(NULL, Text.length, PROT_READ, MAP_PRIVATE, fd, 0);
+	    if (Text.data == MAP_FAILED) {
+		Text.data = NULL;
+		rc = -1;
+	    } else {
+		Text.mapped = 1;
+	    }
+	}
+	if ((rc == 0) && follow) {
+	    Text.fd = fd;
+	} else {
+	    Text.complete = 1;
+	    if (fd != fileno(stdin))
+		close(fd);
+	}
+    } else {
+	/* this will be closed by end_of_text() */
+	Text.fd = fd;
+	if (fd == fileno(stdin)) {
+	    Stdin_Flags = fcntl(fd, F_GETFL);
+	    if (Stdin_Flags != -1)
+		(void) fcntl(fd, F_SETFL, Stdin_Flags | O_NONBLOCK);
+	} else {
+	    (void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	}
+	(void) read_pipe();
+    }
 
-    Line_Window.current_line = (SLscroll_Type *) result;
-    Line_Window.lines = (SLscroll_Type *) result;
-    Line_Window.line_num = 1;
-    Line_Window.num_lines = num_lines;
+    /* index enough lines for the first screen */
+    if (rc == 0)
+	scan_lines(SCAN_LINES);
 
-    return result;
+    return rc;
 }
 
 static void
@@ -315,6 +543,10 @@ update_header(const char *filename, int key)
     SLsmg_printf("view %s %s",
 		 (key > 0) ? keyname(key) : "",
 		 (filename == NULL) ? "<stdin>" : filename);
+    if (Text.pending) {
+	SLsmg_printf(" (indexed %d%%)",
+		     (int) ((100.0 * (double) Text.scanned) / (double) Text.length));
+    }
     SLsmg_erase_eol();
     SLsmg_gotorc(0, SLtt_Screen_Cols - 24);
     SLsmg_printf("%s", ctime(&now));
@@ -324,24 +556,64 @@ update_header(const char *filename, int key)
     SLsig_unblock_signals();
 }
 
+/*
+ * Each line knows its own number, so there is no need to walk the list to
+ * find the number of the top line.
+ */
 static int
-get_lineno(MyData * list, MyData * find)
+get_lineno(MyData * find)
 {
-    MyData *item = list;
-    int result = 0;
-    if (item != 0) {
-	do {
-	    ++result;
-	    if (item == find)
-		break;
-	    item = item->next;
-	} while ((item != 0) && (item != list));
+    return (find != NULL) ? (int) (LineIndex(find) + 1) : 1;
+}
+
+/*
+ * Position the window at the given line, without using SLscroll_next_n or
+ * SLscroll_prev_n, which would walk the list from the current line.
+ */
+static void
+goto_line(MyData * line)
+{
+    if (line != NULL) {
+	Line_Window.top_window_line = (SLscroll_Type *) line;
+	Line_Window.current_line = (SLscroll_Type *) line;
+	Line_Window.line_num = (unsigned) (LineIndex(line) + 1);
     }
-    return result;
+}
+
+/*
+ * Show the last page, working backward from the end of the list.  That costs
+ * one screenful of steps, rather than the whole file.
+ */
+static void
+goto_last_page(MyData * last)
+{
+    MyData *top = last;
+    unsigned n;
+
+    if (top != NULL) {
+	Line_Window.nrows = (unsigned) (SLtt_Screen_Rows - 1);
+	for (n = 1; (n < Line_Window.nrows) && (top->prev != NULL); ++n)
+	    top = top->prev;
+	goto_line(top);
+    }
+}
+
+/*
+ * Check if the last line is on the screen.
+ */
+static int
+at_bottom(void)
+{
+    long top = LineIndex(Line_Window.top_window_line);
+
+    if (top < 0)
+	top = 0;
+    return ((size_t) top + (size_t) (SLtt_Screen_Rows - 1)
+	    >= Line_Window.num_lines);
 }
 
 static void
-update_display(MyData * data, int start_col, int final_row, int no_number)
+update_display(int start_col, int final_row, int no_number)
 {
     int row;
     int param_col = start_col;
@@ -373,7 +645,7 @@ update_display(MyData * data, int start_col, int final_row, int no_number)
 
     row = 1;
     line = (MyData *) Line_Window.top_window_line;
-    start_row = get_lineno(data, line);
+    start_row = get_lineno(line);
 
     SLsmg_normal_video();
 
@@ -384,7 +656,7 @@ update_display(MyData * data, int start_col, int final_row, int no_number)
 	SLsmg_gotorc(row, digits + 1);
 
 	if (line != NULL) {
-	    SLsmg_write_string(line->data);
+	    SLsmg_write_nchars(Text.data + line->offset, (unsigned) line->length);
 	    line = line->next;
 	}
 	SLsmg_erase_eol();
@@ -427,13 +699,13 @@ sigwinch_handler(int sig)
 }
 
 static void
-main_loop(MyData * data, const char *filename, int single_step, int no_number)
+main_loop(const char *filename, int single_step, int no_number, int follow)
 {
     int Screen_Start = 0;
     int screen_start;
-    int screen_final = get_lineno(data, data->prev);
     int done = 0;
     int last_key = -1;
+    int busy;
 
     SLsignal(SIGWINCH, sigwinch_handler);
     while (!done) {
@@ -442,11 +714,39 @@ main_loop(MyData * data, const char *filename, int single_step, int no_number)
 	    SLtt_get_screen_size();
 	    SLsmg_reinit_smg();
 	}
+	/*
+	 * If following the end of the text, show new lines as they arrive.
+	 * Only the new lines differ from the screen's contents (apart from a
+	 * scroll), so SLsmg_refresh has little to repaint.
+	 */
+	if (follow && at_bottom() && !Text.pending) {
+	    if ((busy = more_text()) != 0) {
+		while (scan_lines(SCAN_LINES)) {
+		    ;
+		}
+		goto_last_page(Last_Line);
+	    }
+	} else {
+	    busy = more_text();
+	}
 	update_header(filename, last_key);
-	update_display(data, Screen_Start, screen_final, no_number);
-	if (!single_step && !SLang_input_pending(-50))
-	    continue;
-	switch (last_key = SLkp_getkey()) {
+	update_display(Screen_Start, (int) Line_Window.num_lines, no_number);
+	if (!single_step) {
+	    /* index more of the file while waiting for input */
+	    if (busy || Text.pending) {
+		if (!SLang_input_pending(0)) {
+		    scan_lines(SCAN_LINES);
+		    continue;
+		}
+	    } else if (!SLang_input_pending(-50)) {
+		continue;
+	    }
+	}
+	last_key = SLkp_getkey();
+	/* moving forward may need lines which are not yet indexed */
+	need_lines((size_t) (LineIndex(Line_Window.top_window_line) + 1)
+		   + (size_t) (2 * SLtt_Screen_Rows));
+	switch (last_key) {
 	case SL_KEY_ERR:
 	case 'q':
 	case 'Q':
@@ -504,11 +804,13 @@ main_loop(MyData * data, const char *filename, int single_step, int no_number)
 	    break;
 
 	case SL_KEY_HOME:
-	    while (-1 != SLscroll_pageup(&Line_Window)) ;
+	    goto_line(Lines);
 	    break;
 
 	case SL_KEY_END:
-	    while (-1 != SLscroll_pagedown(&Line_Window)) ;
+	    while (scan_lines(SCAN_LINES))
+		update_header(filename, last_key);
+	    goto_last_page(Last_Line);
 	    break;
 
 	default:
@@ -520,7 +822,7 @@ main_loop(MyData * data, const char *filename, int single_step, int no_number)
 static void
 usage(char *pgm)
 {
-    fprintf(stderr, "Usage: %s [-c] [-i] [-n] [-s] [FILENAME]\n", pgm);
+    fprintf(stderr, "Usage: %s [-c] [-f] [-i] [-n] [-s] [FILENAME]\n", pgm);
     exit(EXIT_FAILURE);
 }
 
@@ -532,14 +834,18 @@ main(int argc, char **argv)
     int ignore_sigs = 0;
     int single_step = 0;
     int no_numbers = 0;
+    int follow = 0;
     char *filename = NULL;
-    MyData *my_data;
 
-    while ((i = getopt(argc, argv, "cins")) != -1) {
+    while ((i = getopt(argc, argv, "cfins")) != -1) {
 	switch (i) {
 	case 'c':
 	    try_color = 1;
 	    break;
+	case 'f':
+	    /* like "tail -f", show lines added to the end of the file */
+	    follow = 1;
+	    break;
 	case 'i':
 	    ignore_sigs = 1;
 	    break;
@@ -560,13 +866,18 @@ main(int argc, char **argv)
 	    usage(argv[0]);
 	}
     }
-    if (optind + 1 != argc)
+    if (optind + 1 < argc)
 	usage(argv[0]);
 
-    filename = argv[optind];
+    /* read from a pipe if no filename is given */
+    if (optind < argc && strcmp(argv[optind], "-"))
+	filename = argv[optind];
+    else if (isatty(fileno(stdin)))
+	usage(argv[0]);
 
-    if ((my_data = ReadFile(filename)) == NULL) {
-	fprintf(stderr, "Unable to read %s\n", filename);
+    if (ReadFile(filename, follow) < 0) {
+	fprintf(stderr, "Unable to read %s\n",
+		(filename == NULL) ? "<stdin>" : filename);
 	return EXIT_FAILURE;
     }
 
@@ -575,12 +886,13 @@ main(int argc, char **argv)
     SLsignal(SIGTERM, ignore_sigs ? SIG_IGN : finish);
 
     if (-1 == InitializeTerminal()) {
+	restore_stdin();
 	fprintf(stderr, "Unable to initialize terminal.");
 	return EXIT_FAILURE;
     }
 
     if (try_color)
 	SLtt_set_color(0, NULL, "white", "blue");
-    main_loop(my_data, filename, single_step, no_numbers);
+    main_loop(filename, single_step, no_numbers, follow);
     finish(0);
 }
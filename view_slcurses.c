@@ -63,26 +63,33 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <wchar.h>
 #include <assert.h>
 #include <signal.h>
 #include <locale.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <time.h>
 
+#include <slstats.h>
+
 #ifdef __GNUC__
 #define GCC_NORETURN __attribute__((noreturn))
 #else
 #define GCC_NORETURN		/* nothing */
 #endif
 
-#define CCHAR_T SLcurses_Cell_Type
-
 #undef CTRL			/* conflict on AIX 5.2 with <sys/ioctl.h> */
 
 #define UChar(c) (unsigned char)(c)
 
+#ifndef OK
+#define OK (0)
+#endif
+
 #define reset_mbytes(state) IGNORE_RC(mblen(NULL, 0)), IGNORE_RC(mbtowc(NULL, NULL, 0))
 #define count_mbytes(buffer,length,state) mblen(buffer,length)
 #define check_mbytes(wch,buffer,length,state) \
@@ -98,9 +105,13 @@ static int shift = 0;
 static bool try_color = FALSE;
 
 static char *fname;
-static CCHAR_T **vec_lines;
-static CCHAR_T **lptr;
+static FILE *fp;		/* the file, until it has been read */
+static long file_size;		/* the file's size, if known */
+static char **vec_lines;
+static char **lptr;
 static int num_lines;
+static int max_lines;		/* allocated size of vec_lines */
+static int limit_lines;		/* limit from "-n" option, if nonzero */
 
 static void usage(void);
 
@@ -114,7 +125,7 @@ usage(void)
 	,"Options:"
 	," -c       use color if terminal supports it"
 	," -i       ignore INT, QUIT, TERM signals"
-	," -n NUM   specify maximum number of lines (default 1000)"
+	," -n NUM   specify maximum number of lines (default: no limit)"
 	," -s       start in single-step mode, waiting for input"
 #ifdef TRACE
 	," -t       trace screen updates"
@@ -127,17 +138,6 @@ usage(void)
     exit(EXIT_FAILURE);
 }
 
-/* MISSING */
-static void
-addchstr(CCHAR_T * s)
-{
-    while (s->main) {
-	/* slcurses has no way to specify color/attributes in addch */
-	addch(s->main);
-	++s;
-    }
-}
-
 /* MISSING */
 static void
 halfdelay(int n)
@@ -175,45 +175,231 @@ redrawwin(WINDOW *w)
     wrefresh(w);
 }
 
-#if 0
-/* slcurses doesn't have scrolling regions, though this function exists.
- * It simply doesn't work with slcurses.
+/* MISSING
+ * slcurses has a scrolling region, used by wscrl, but its wsetscrreg macro
+ * takes the bottom margin as a limit rather than the last line.
  */
-static void
+static int
 setscrreg(int t, int b)
 {
-    SLtt_set_scroll_region(t, b);
+    if (t < 0 || b >= (int) stdscr->nrows || t > b)
+	return ERR;
+    stdscr->scroll_min = (unsigned) t;
+    stdscr->scroll_max = (unsigned) b + 1;
+    return OK;
 }
-#endif
 
-static int
-ch_len(CCHAR_T * src)
+/*
+ * Scroll the text rows, remembering how far they moved so that show_all can
+ * repaint only the lines which were exposed.  slang's refresh notices that
+ * the other lines were shifted, and moves them using the terminal's
+ * scrolling region.
+ */
+static int scrolled;		/* lines scrolled since the last show_all */
+
+static void
+scroll_lines(int n)
 {
-    int result = 0;
+    if (n != 0 && scrl(n) != ERR)
+	scrolled += n;
+}
 
-    while (src->main) {
-	src++;
-	result++;
+/*
+ * The text of each line is kept in large blocks, rather than allocated
+ * separately.  Only the lines which are shown are expanded into cells.
+ */
+typedef struct _arena {
+    struct _arena *next;
+    size_t used;
+    size_t size;
+    char text[1];
+} ARENA;
+
+#define ARENA_SIZE 0x100000	/* default size of a block */
+
+static ARENA *arena;
+
+static char *
+arena_dup(const char *src, size_t len)
+{
+    char *dst;
+
+    if (arena == 0 || (arena->used + len + 1) > arena->size) {
+	size_t size = ((len + 1) > ARENA_SIZE) ? (len + 1) : ARENA_SIZE;
+	ARENA *block = malloc(sizeof(ARENA) + size);
+
+	if (block == 0)
+	    return 0;
+	block->next = arena;
+	block->used = 0;
+	block->size = size;
+	arena = block;
+    }
+    dst = arena->text + arena->used;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    arena->used += len + 1;
+    return dst;
+}
+
+static void
+arena_free(void)
+{
+    while (arena != 0) {
+	ARENA *next = arena->next;
+	free(arena);
+	arena = next;
     }
-    return result;
 }
 
 /*
- * Allocate a string into an array of chtype's.  If UTF-8 mode is
- * active, translate the string accordingly.
+ * Write the visible part of a converted line, from the cursor to the right
+ * margin, as a single call rather than one addch per cell.  The text has
+ * already been converted to printable single-byte characters, so bytes and
+ * columns are the same.  Like addch, slcurses uses the window's attributes.
+ *
+ * SLcurses_waddnstr writes n bytes regardless of a null, so the count must
+ * not exceed the length of the text.
  */
-static CCHAR_T *
-ch_dup(char *src)
+static void
+add_slice(char *s, int len)
 {
-    unsigned len = (unsigned) strlen(src);
-    CCHAR_T *dst = malloc(sizeof(CCHAR_T) * (len + 1));
-    size_t j, k;
+    int room = COLS - (int) stdscr->_curx;
+
+    if (room > len)
+	room = len;
+    if (room > 0)
+	waddnstr(stdscr, s, room);
+}
 
-    for (j = k = 0; j < len; j++) {
-	dst[k++].main = (chtype) UChar(src[j]);
+/*
+ * Tables for converting tabs and nonprinting characters.  These are built on
+ * first use, since isprint depends on the locale.
+ */
+static bool plain_char[256];	/* characters which are copied as-is */
+static char octal_char[256][5];	/* octal escapes for nonprinting characters */
+
+#define ONES_8 (~(uint64_t) 0 / 255)	/* 0x0101010101010101 */
+
+/* true if any of the 8 bytes in x is not printable ASCII */
+#define NOT_ASCII_8(x) \
+	((((x) - (ONES_8 * ' ')) & ~(x)) | (x) | ((x) + ONES_8)) & (ONES_8 * 0x80)
+
+/*
+ * Convert tabs and nonprinting chars so that shift will work properly.  Runs
+ * of printable characters are copied in bulk, checking 8 bytes at a time for
+ * ASCII.  The source buffer must have room to read 8 bytes past its null.
+ *
+ * The line ends at a newline or carriage return.  A tab expands to spaces up
+ * to the next multiple of 8 columns, which may be 8 times the length of the
+ * source.
+ */
+static size_t
+convert_line(const char *src, char *dst)
+{
+    static bool initialized = FALSE;
+    char *d = dst;
+    size_t run;
+
+    if (!initialized) {
+	int c;
+	for (c = 0; c < 256; ++c) {
+	    plain_char[c] = (c != '\t' && c != '\r' && c != '\n' && isprint(c));
+	    sprintf(octal_char[c], "\\%03o", c);
+	}
+	initialized = TRUE;
+    }
+
+    for (;;) {
+	const char *s = src;
+	uint64_t block;
+
+	for (;;) {
+	    memcpy(&block, s, sizeof(block));
+	    if (NOT_ASCII_8(block))
+		break;
+	    s += sizeof(block);
+	}
+	while (plain_char[UChar(*s)])
+	    ++s;
+	run = (size_t) (s - src);
+	memcpy(d, src, run);
+	d += run;
+	src = s;
+
+	switch (*src) {
+	case '\0':
+	case '\n':
+	case '\r':
+	    *d = '\0';
+	    return (size_t) (d - dst);
+	case '\t':
+	    run = (size_t) ((((d - dst) | 7) + 1) - (d - dst));
+	    memset(d, ' ', run);
+	    d += run;
+	    break;
+	default:
+	    memcpy(d, octal_char[UChar(*src)], (size_t) 4);
+	    d += 4;
+	    break;
+	}
+	++src;
+    }
+}
+
+#define READ_LINES 1000		/* lines to read per step */
+
+/*
+ * Read up to "count" more lines from the file, returning TRUE if there may be
+ * more to read.  The file is closed when it is completely read.
+ */
+static bool
+read_lines(int count)
+{
+    char buf[BUFSIZ + sizeof(uint64_t)];
+    char temp[8 * BUFSIZ];
+
+    while ((count-- > 0) && (fp != 0)) {
+	if (((limit_lines > 0) && (num_lines >= limit_lines))
+	    || (fgets(buf, BUFSIZ, fp) == 0)) {
+	    (void) fclose(fp);
+	    fp = 0;
+	    break;
+	}
+	if (num_lines + 1 >= max_lines) {
+	    long offset = (long) (lptr - vec_lines);
+	    int need = 2 * max_lines;
+	    char **bigger = realloc(vec_lines, sizeof(char *) * (size_t) need);
+
+	    if (bigger == 0) {
+		(void) fclose(fp);
+		fp = 0;
+		break;
+	    }
+	    vec_lines = bigger;
+	    max_lines = need;
+	    lptr = vec_lines + offset;
+	}
+
+	if ((vec_lines[num_lines] = arena_dup(temp, convert_line(buf, temp))) == 0) {
+	    (void) fclose(fp);
+	    fp = 0;
+	    break;
+	}
+	vec_lines[++num_lines] = 0;
+    }
+    return (fp != 0);
+}
+
+/*
+ * Make sure that at least "count" lines are read, if the file has that many.
+ */
+static void
+need_lines(int count)
+{
+    while ((num_lines < count) && read_lines(READ_LINES)) {
+	;
     }
-    dst[k].main = 0;
-    return dst;
 }
 
 static void finish(int) GCC_NORETURN;
@@ -222,6 +408,8 @@ static void
 finish(int sig)
 {
     endwin();
+    arena_free();
+    free(vec_lines);
     exit(sig != 0 ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
@@ -230,11 +418,22 @@ show_all(const char *tag)
 {
     int i;
     char temp[BUFSIZ];
-    CCHAR_T *s;
+    char *s;
     time_t this_time;
+    int first, last;
+    unsigned long before;
 
     (void) tag;
-    sprintf(temp, "view %.*s", (int) sizeof(temp) - 7, fname);
+    sprintf(temp, "view %.*s", (int) sizeof(temp) - 40, fname);
+    if (fp != 0) {
+	long offset = ftell(fp);
+	if ((file_size > 0) && (offset >= 0)) {
+	    sprintf(temp + strlen(temp), " (reading %ld%%)",
+		    (offset * 100) / file_size);
+	} else {
+	    sprintf(temp + strlen(temp), " (reading %d lines)", num_lines);
+	}
+    }
 
     move(0, 0);
     printw("%.*s", COLS, temp);
@@ -247,32 +446,48 @@ show_all(const char *tag)
 	    printw("  %s", temp);
     }
 
+    if (scrolled > 0 && scrolled < LINES - 1) {
+	first = LINES - scrolled;
+	last = LINES - 1;
+    } else if (scrolled < 0 && -scrolled < LINES - 1) {
+	first = 1;
+	last = -scrolled;
+    } else {
+	first = 1;
+	last = LINES - 1;
+    }
+
     scrollok(stdscr, FALSE);	/* prevent screen from moving */
-    for (i = 1; i < LINES; i++) {
+    for (i = first; i <= last; i++) {
 	move((unsigned) i, 0);
 	printw("%3ld:", (long) (lptr + i - vec_lines));
 	clrtoeol();
-	if ((s = lptr[i - 1]) != 0) {
-	    int len = ch_len(s);
+	if ((lptr + i - 1 < vec_lines + num_lines)
+	    && (s = lptr[i - 1]) != 0) {
+	    int len = (int) strlen(s);
 	    if (len > shift) {
-		addchstr(s + shift);
+		add_slice(s + shift, len - shift);
 	    }
 	}
     }
     scrollok(stdscr, TRUE);
-    /* MISSING setscrreg(1, LINES - 1); */
+    setscrreg(1, LINES - 1);
+
+    before = SLtt_Num_Chars_Output;
     refresh();
+    if (scrolled != 0) {
+	slstats_scrolled(SLtt_Num_Chars_Output - before);
+	scrolled = 0;
+    }
 }
 
 int
 main(int argc, char *argv[])
 {
-    int MAXLINES = 1000;
-    FILE *fp;
-    char buf[BUFSIZ];
+    struct stat sb;
     int i;
     int my_delay = 0;
-    CCHAR_T **olptr;
+    char **olptr;
     int value = 0;
     bool done = FALSE;
     bool got_number = FALSE;
@@ -298,8 +513,8 @@ main(int argc, char *argv[])
 	    signal(SIGTERM, SIG_IGN);
 	    break;
 	case 'n':
-	    if ((MAXLINES = atoi(optarg)) < 1 ||
-		(MAXLINES + 2) <= 1)
+	    if ((limit_lines = atoi(optarg)) < 1 ||
+		(limit_lines + 2) <= 1)
 		usage();
 	    break;
 	case 's':
@@ -326,53 +541,20 @@ main(int argc, char *argv[])
     if (optind + 1 != argc)
 	usage();
 
-    if ((vec_lines = calloc(1, sizeof(CCHAR_T) * (size_t) MAXLINES + 2)) == 0)
+    max_lines = READ_LINES;
+    if ((vec_lines = calloc((size_t) max_lines, sizeof(char *))) == 0)
 	usage();
 
     assert(vec_lines != 0);
+    lptr = vec_lines;
 
     fname = argv[optind];
     if ((fp = fopen(fname, "r")) == 0) {
 	perror(fname);
 	exit(EXIT_FAILURE);
     }
-
-    for (lptr = &vec_lines[0]; (lptr - vec_lines) < MAXLINES; lptr++) {
-	char temp[BUFSIZ], *s, *d;
-	int col;
-
-	if (fgets(buf, sizeof(buf), fp) == 0)
-	    break;
-
-	/* convert tabs and nonprinting chars so that shift will work properly */
-	for (s = buf, d = temp, col = 0; (*d = *s) != '\0'; s++) {
-	    if (*d == '\r') {
-		if (s[1] == '\n') {
-		    continue;
-		} else {
-		    break;
-		}
-	    }
-	    if (*d == '\n') {
-		*d = '\0';
-		break;
-	    } else if (*d == '\t') {
-		col = (col | 7) + 1;
-		while ((d - temp) != col)
-		    *d++ = ' ';
-	    } else if (isprint(UChar(*d))) {
-		col++;
-		d++;
-	    } else {
-		sprintf(d, "\\%03o", UChar(*s));
-		d += strlen(d);
-		col = (int) (d - temp);
-	    }
-	}
-	*lptr = ch_dup(temp);
-    }
-    (void) fclose(fp);
-    num_lines = (int) (lptr - vec_lines);
+    if ((fstat(fileno(fp), &sb) == 0) && S_ISREG(sb.st_mode))
+	file_size = (long) sb.st_size;
 
     (void) initscr();		/* initialize the curses library */
     keypad(stdscr, TRUE);	/* enable keyboard mapping */
@@ -392,6 +574,9 @@ main(int argc, char *argv[])
 	}
     }
 
+    /* the rest of the file is read while waiting for input, or on demand */
+    need_lines(LINES);
+
     lptr = vec_lines;
     while (!done) {
 	int n, c;
@@ -423,13 +608,14 @@ main(int argc, char *argv[])
 	switch (c) {
 	case KEY_DOWN:
 	case 'n':
+	    need_lines((int) (lptr - vec_lines) + n + LINES);
 	    olptr = lptr;
 	    for (i = 0; i < n; i++)
 		if ((lptr - vec_lines) < (num_lines - LINES + 1))
 		    lptr++;
 		else
 		    break;
-	    scrl((int) (lptr - olptr));
+	    scroll_lines((int) (lptr - olptr));
 	    break;
 
 	case KEY_UP:
@@ -440,7 +626,7 @@ main(int argc, char *argv[])
 		    lptr--;
 		else
 		    break;
-	    scrl((int) (lptr - olptr));
+	    scroll_lines((int) (lptr - olptr));
 	    break;
 
 	case 'h':
@@ -450,6 +636,8 @@ main(int argc, char *argv[])
 
 	case 'e':
 	case KEY_END:
+	    while (read_lines(READ_LINES))
+		show_all(my_label);
 	    if (num_lines > LINES)
 		lptr = vec_lines + num_lines - LINES + 1;
 	    else
@@ -490,7 +678,9 @@ main(int argc, char *argv[])
 	    redrawwin(stdscr);
 	    break;
 	case ERR:
-	    if (!my_delay)
+	    if (fp != 0)
+		read_lines(READ_LINES);
+	    else if (!my_delay)
 		napms(50);
 	    break;
 	default:
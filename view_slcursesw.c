@@ -64,9 +64,13 @@
 #include <assert.h>
 #include <signal.h>
 #include <locale.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <time.h>
 
+#include <slstats.h>
+
 #undef CTRL			/* conflict on AIX 5.2 with <sys/ioctl.h> */
 
 /*
@@ -111,9 +115,13 @@ static int shift = 0;
 static bool try_color = FALSE;
 
 static char *fname;
-static cchar_t **vec_lines;
-static cchar_t **lptr;
+static FILE *fp;		/* the file, until it has been read */
+static long file_size;		/* the file's size, if known */
+static char **vec_lines;
+static char **lptr;
 static int num_lines;
+static int max_lines;		/* allocated size of vec_lines */
+static int limit_lines;		/* limit from "-n" option, if nonzero */
 
 static void
 usage(void)
@@ -125,7 +133,7 @@ usage(void)
 	,"Options:"
 	," -c       use color if terminal supports it"
 	," -i       ignore INT, QUIT, TERM signals"
-	," -n NUM   specify maximum number of lines (default 1000)"
+	," -n NUM   specify maximum number of lines (default: no limit)"
 	," -s       start in single-step mode, waiting for input"
 #ifdef TRACE
 	," -t       trace screen updates"
@@ -144,22 +152,49 @@ usage(void)
 static void
 add_wchstr(cchar_t *s)
 {
+    static char *buffer;
+    static size_t length;
+    size_t need = ((size_t) COLS * CCHARW_MAX * (size_t) MB_CUR_MAX) + 1;
+    int room = COLS - (int) stdscr->_curx;
+    char *d;
     int n;
 
-    while (s->main) {
-	/*
-	 * slcurses's "addch" is sufficiently different from curses that the
-	 * only useful part is the character:
-	 * a) only the foreground color is used, but
-	 * b) the color+video attributes are OR'd with the window attributes,
-	 * c) largely because slcurses confuses bold and reverse with color.
-	 */
-	addch(s->main & A_CHARTEXT);
-	for (n = 0; n < SLSMG_MAX_CHARS_PER_CELL; ++n) {
-	    addch(s->combining[n]);
+    if (length < need) {
+	length = need;
+	buffer = realloc(buffer, length);
+	assert(buffer != 0);
+    }
+
+    /*
+     * slcurses's "addch" is sufficiently different from curses that the
+     * only useful part is the character:
+     * a) only the foreground color is used, but
+     * b) the color+video attributes are OR'd with the window attributes,
+     * c) largely because slcurses confuses bold and reverse with color.
+     *
+     * So rather than adding the base and combining characters one by one,
+     * encode the part of the row which fits on the screen, and write that
+     * with a single call.  slcurses attaches the combining characters to
+     * the preceding cell, as addch would.
+     */
+    for (d = buffer; s->main && room > 0; ++s) {
+	int width = wcwidth((wchar_t) (s->main & A_CHARTEXT));
+	int rc;
+
+	if (width < 1)
+	    width = 1;
+	if (width > room)
+	    break;
+	room -= width;
+	if ((rc = wctomb(d, (wchar_t) (s->main & A_CHARTEXT))) > 0)
+	    d += rc;
+	for (n = 0; n < CCHARW_MAX - 1 && s->combining[n] != 0; ++n) {
+	    if ((rc = wctomb(d, (wchar_t) s->combining[n])) > 0)
+		d += rc;
 	}
-	++s;
     }
+    if (d != buffer)
+	waddnstr(stdscr, buffer, (int) (d - buffer));
 }
 
 /* MISSING */
@@ -212,6 +247,54 @@ setscrreg(int t, int b)
 
 #endif /* SLANG_VERSION */
 
+/*
+ * The text of each line is kept in large blocks, rather than allocated
+ * separately.  Only the lines which are shown are expanded into cells.
+ */
+typedef struct _arena {
+    struct _arena *next;
+    size_t used;
+    size_t size;
+    char text[1];
+} ARENA;
+
+#define ARENA_SIZE 0x100000	/* default size of a block */
+
+static ARENA *arena;
+
+static char *
+arena_dup(const char *src, size_t len)
+{
+    char *dst;
+
+    if (arena == 0 || (arena->used + len + 1) > arena->size) {
+	size_t size = ((len + 1) > ARENA_SIZE) ? (len + 1) : ARENA_SIZE;
+	ARENA *block = malloc(sizeof(ARENA) + size);
+
+	if (block == 0)
+	    return 0;
+	block->next = arena;
+	block->used = 0;
+	block->size = size;
+	arena = block;
+    }
+    dst = arena->text + arena->used;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    arena->used += len + 1;
+    return dst;
+}
+
+static void
+arena_free(void)
+{
+    while (arena != 0) {
+	ARENA *next = arena->next;
+	free(arena);
+	arena = next;
+    }
+}
+
 static int
 ch_len(cchar_t *src)
 {
@@ -240,13 +323,13 @@ setcchar(cchar_t *wcval, const wchar_t *wch, const attr_t attrs, short
 }
 
 /*
- * Allocate a string into an array of cchar_t's.
+ * Decode a string into an array of cchar_t's, which must have room for one
+ * more than the length of the string.
  */
 static cchar_t *
-ch_dup(char *src)
+ch_decode(const char *src, cchar_t *dst)
 {
     unsigned len = (unsigned) strlen(src);
-    cchar_t *dst = calloc(sizeof(cchar_t), len + 1);
     size_t j, k;
     wchar_t wstr[SLSMG_MAX_CHARS_PER_CELL + 1];
     wchar_t wch;
@@ -256,12 +339,18 @@ ch_dup(char *src)
 
     reset_mbytes(state);
     for (j = k = 0; j < len; j++) {
-	rc = (size_t) check_mbytes(wch, src + j, len - j, state);
-	if (rc == (size_t) -1 || rc == (size_t) -2) {
-	    break;
+	if (UChar(src[j]) < 128) {
+	    /* ASCII needs no conversion, and its width is not zero */
+	    wch = (wchar_t) UChar(src[j]);
+	    width = 1;
+	} else {
+	    rc = (size_t) check_mbytes(wch, src + j, len - j, state);
+	    if (rc == (size_t) -1 || rc == (size_t) -2) {
+		break;
+	    }
+	    j += rc - 1;
+	    width = wcwidth(wch);
 	}
-	j += rc - 1;
-	width = wcwidth(wch);
 	if (width == 0) {
 	    if (l == 0) {
 		wstr[l++] = L' ';
@@ -286,6 +375,183 @@ ch_dup(char *src)
     return dst;
 }
 
+/*
+ * Lines are decoded only when they are shown.  Keep the decoded rows for the
+ * last few screens in a cache, so that scrolling back and forth does not
+ * decode them again.  The least-recently used row is reused for a new line.
+ */
+typedef struct _cached {
+    struct _cached *newer;	/* LRU list, from newest to oldest */
+    struct _cached *older;
+    struct _cached *chain;	/* hash-chain */
+    long lineno;		/* the line's index in vec_lines, or -1 */
+    cchar_t *cells;		/* the decoded line */
+    size_t size;		/* allocated size of cells[] */
+    int length;			/* number of cells used */
+} CACHED;
+
+#define CACHE_SCREENS 4		/* number of screens to cache */
+
+static CACHED *cache;
+static CACHED **cache_hash;
+static CACHED *cache_newest;
+static CACHED *cache_oldest;
+static int cache_size;
+
+static void
+cache_free(void)
+{
+    int n;
+
+    for (n = 0; n < cache_size; ++n)
+	free(cache[n].cells);
+    free(cache);
+    free(cache_hash);
+    cache = 0;
+    cache_hash = 0;
+    cache_newest = cache_oldest = 0;
+    cache_size = 0;
+}
+
+static void
+cache_init(int size)
+{
+    int n;
+
+    cache_free();
+    cache = calloc((size_t) size, sizeof(CACHED));
+    cache_hash = calloc((size_t) size, sizeof(CACHED *));
+    assert(cache != 0 && cache_hash != 0);
+    cache_size = size;
+    for (n = 0; n < size; ++n) {
+	cache[n].lineno = -1;
+	cache[n].newer = (n > 0) ? &cache[n - 1] : 0;
+	cache[n].older = (n + 1 < size) ? &cache[n + 1] : 0;
+    }
+    cache_newest = &cache[0];
+    cache_oldest = &cache[size - 1];
+}
+
+static void
+cache_unlink(CACHED * p)
+{
+    if (p->newer != 0)
+	p->newer->older = p->older;
+    else
+	cache_newest = p->older;
+    if (p->older != 0)
+	p->older->newer = p->newer;
+    else
+	cache_oldest = p->newer;
+}
+
+static void
+cache_touch(CACHED * p)
+{
+    if (p != cache_newest) {
+	cache_unlink(p);
+	p->newer = 0;
+	p->older = cache_newest;
+	cache_newest->newer = p;
+	cache_newest = p;
+    }
+}
+
+/*
+ * Return the decoded cells for the given line.
+ */
+static CACHED *
+cache_lookup(long lineno)
+{
+    CACHED **bucket = &cache_hash[lineno % cache_size];
+    CACHED *p;
+    size_t need;
+
+    for (p = *bucket; p != 0; p = p->chain) {
+	if (p->lineno == lineno) {
+	    cache_touch(p);
+	    return p;
+	}
+    }
+
+    /* reuse the oldest entry, removing it from its hash-chain */
+    p = cache_oldest;
+    if (p->lineno >= 0) {
+	CACHED **q = &cache_hash[p->lineno % cache_size];
+	while (*q != p)
+	    q = &((*q)->chain);
+	*q = p->chain;
+    }
+
+    need = strlen(vec_lines[lineno]) + 1;
+    if (p->size < need) {
+	p->size = need;
+	p->cells = realloc(p->cells, sizeof(cchar_t) * p->size);
+	assert(p->cells != 0);
+    }
+    memset(p->cells, 0, sizeof(cchar_t) * need);
+    p->length = ch_len(ch_decode(vec_lines[lineno], p->cells));
+    p->lineno = lineno;
+    p->chain = *bucket;
+    *bucket = p;
+    cache_touch(p);
+    return p;
+}
+
+#define READ_LINES 1000		/* lines to read per step */
+
+/*
+ * Read up to "count" more lines from the file, returning TRUE if there may be
+ * more to read.  The file is closed when it is completely read.
+ */
+static bool
+read_lines(int count)
+{
+    char buf[BUFSIZ];
+
+    while ((count-- > 0) && (fp != 0)) {
+	if (((limit_lines > 0) && (num_lines >= limit_lines))
+	    || (fgets(buf, sizeof(buf), fp) == 0)) {
+	    (void) fclose(fp);
+	    fp = 0;
+	    break;
+	}
+	if (num_lines + 1 >= max_lines) {
+	    long offset = (long) (lptr - vec_lines);
+	    int need = 2 * max_lines;
+	    char **bigger = realloc(vec_lines, sizeof(char *) * (size_t) need);
+
+	    if (bigger == 0) {
+		(void) fclose(fp);
+		fp = 0;
+		break;
+	    }
+	    vec_lines = bigger;
+	    max_lines = need;
+	    lptr = vec_lines + offset;
+	}
+
+	if ((vec_lines[num_lines] = arena_dup(buf, strlen(buf))) == 0) {
+	    (void) fclose(fp);
+	    fp = 0;
+	    break;
+	}
+	vec_lines[++num_lines] = 0;
+    }
+    return (fp != 0);
+}
+
+/*
+ * Make sure that at least "count" lines are read, if the file has that many.
+ */
+static void
+need_lines(int count)
+{
+    while ((num_lines < count) && read_lines(READ_LINES)) {
+	;
+    }
+}
+
 #ifdef __GNUC__
 #define GCC_NORETURN __attribute__((noreturn))
 #else
@@ -298,6 +564,9 @@ static void
 finish(int sig)
 {
     endwin();
+    arena_free();
+    cache_free();
+    free(vec_lines);
     exit(sig != 0 ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
@@ -306,11 +575,22 @@ show_all(const char *tag)
 {
     int i;
     char temp[BUFSIZ];
-    cchar_t *s;
     time_t this_time;
 
     (void) tag;
-    sprintf(temp, "view %.*s", (int) sizeof(temp) - 7, fname);
+    if (cache_size != CACHE_SCREENS * LINES)
+	cache_init(CACHE_SCREENS * LINES);
+
+    sprintf(temp, "view %.*s", (int) sizeof(temp) - 40, fname);
+    if (fp != 0) {
+	long offset = ftell(fp);
+	if ((file_size > 0) && (offset >= 0)) {
+	    sprintf(temp + strlen(temp), " (reading %ld%%)",
+		    (offset * 100) / file_size);
+	} else {
+	    sprintf(temp + strlen(temp), " (reading %d lines)", num_lines);
+	}
+    }
 
     move(0, 0);
     printw("%.*s", COLS, temp);
@@ -328,10 +608,11 @@ show_all(const char *tag)
 	move((unsigned) i, 0);
 	printw("%3ld:", (long) (lptr + i - vec_lines));
 	clrtoeol();
-	if ((s = lptr[i - 1]) != 0) {
-	    int len = ch_len(s);
-	    if (len > shift) {
-		add_wchstr(s + shift);
+	if ((lptr + i - 1 < vec_lines + num_lines)
+	    && (lptr[i - 1] != 0)) {
+	    CACHED *row = cache_lookup((long) (lptr + i - 1 - vec_lines));
+	    if (row->length > shift) {
+		add_wchstr(row->cells + shift);
 	    }
 	}
     }
@@ -343,12 +624,10 @@ show_all(const char *tag)
 int
 main(int argc, char *argv[])
 {
-    int MAXLINES = 1000;
-    FILE *fp;
-    char buf[BUFSIZ];
+    struct stat sb;
     int i;
     int my_delay = 0;
-    cchar_t **olptr;
+    char **olptr;
     int value = 0;
     bool done = FALSE;
     bool got_number = FALSE;
@@ -374,8 +653,8 @@ main(int argc, char *argv[])
 	    signal(SIGTERM, SIG_IGN);
 	    break;
 	case 'n':
-	    if ((MAXLINES = atoi(optarg)) < 1 ||
-		(MAXLINES + 2) <= 1)
+	    if ((limit_lines = atoi(optarg)) < 1 ||
+		(limit_lines + 2) <= 1)
 		usage();
 	    break;
 	case 's':
@@ -402,25 +681,20 @@ main(int argc, char *argv[])
     if (optind + 1 != argc)
 	usage();
 
-    if ((vec_lines = calloc(1, sizeof(cchar_t) * (size_t) MAXLINES + 2)) == 0)
-	  usage();
+    max_lines = READ_LINES;
+    if ((vec_lines = calloc((size_t) max_lines, sizeof(char *))) == 0)
+	usage();
 
     assert(vec_lines != 0);
+    lptr = vec_lines;
 
     fname = argv[optind];
     if ((fp = fopen(fname, "r")) == 0) {
 	perror(fname);
 	exit(EXIT_FAILURE);
     }
-
-    for (lptr = &vec_lines[0]; (lptr - vec_lines) < MAXLINES; lptr++) {
-	if (fgets(buf, sizeof(buf), fp) == 0)
-	    break;
-
-	*lptr = ch_dup(buf);
-    }
-    (void) fclose(fp);
-    num_lines = (int) (lptr - vec_lines);
+    if ((fstat(fileno(fp), &sb) == 0) && S_ISREG(sb.st_mode))
+	file_size = (long) sb.st_size;
 
     (void) initscr();		/* initialize the curses library */
     keypad(stdscr, TRUE);	/* enable keyboard mapping */
@@ -440,6 +714,9 @@ main(int argc, char *argv[])
 	}
     }
 
+    /* the rest of the file is read while waiting for input, or on demand */
+    need_lines(LINES);
+
     lptr = vec_lines;
     while (!done) {
 	int n, c;
@@ -471,6 +748,7 @@ main(int argc, char *argv[])
 	switch (c) {
 	case KEY_DOWN:
 	case 'n':
+	    need_lines((int) (lptr - vec_lines) + n + LINES);
 	    olptr = lptr;
 	    for (i = 0; i < n; i++)
 		if ((lptr - vec_lines) < (num_lines - LINES + 1))
@@ -498,6 +776,8 @@ main(int argc, char *argv[])
 
 	case 'e':
 	case KEY_END:
+	    while (read_lines(READ_LINES))
+		show_all(my_label);
 	    if (num_lines > LINES)
 		lptr = vec_lines + num_lines - LINES + 1;
 	    else
@@ -538,7 +818,9 @@ main(int argc, char *argv[])
 	    redrawwin(stdscr);
 	    break;
 	case ERR:
-	    if (!my_delay)
+	    if (fp != 0)
+		read_lines(READ_LINES);
+	    else if (!my_delay)
 		napms(50);
 	    break;
 	default:
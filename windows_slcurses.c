@@ -0,0 +1,410 @@
+/****************************************************************************
+ * Copyright 2017 by Thomas E. Dickey                                       *
+ *                                                                          *
+ * Permission is hereby granted, free of charge, to any person obtaining a  *
+ * copy of this software and associated documentation files (the            *
+ * "Software"), to deal in the Software without restriction, including      *
+ * without limitation the rights to use, copy, modify, merge, publish,      *
+ * distribute, distribute with modifications, sublicense, and/or sell       *
+ * copies of the Software, and to permit persons to whom the Software is    *
+ * furnished to do so, subject to the following conditions:                 *
+ *                                                                          *
+ * This is a supporting work for discussion of the ncurses and slang        *
+ * libraries, consequently the permission notice requires this URL to be    *
+ * included:                                                                *
+ *      https://invisible-island.net/ncurses/ncurses-slang.html             *
+ *                                                                          *
+ * The above copyright notice and this permission notice shall be included  *
+ * in all copies or substantial portions of the Software.                   *
+ *                                                                          *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  *
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF               *
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.   *
+ * IN NO EVENT SHALL THE ABOVE COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR    *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR    *
+ * THE USE OR OTHER DEALINGS IN THE SOFTWARE.                               *
+ *                                                                          *
+ * Except as contained in this notice, the name(s) of the above copyright   *
+ * holders shall not be used in advertising or otherwise to promote the     *
+ * sale, use or other dealings in this Software without prior written       *
+ * authorization.                                                           *
+ ****************************************************************************/
+/*
+ * $Id$
+ *
+ * Stress the slcurses window layer, as extended by with-slcurses, using a
+ * growing number of tiled windows.  Each tile is a window with a border and
+ * a subwindow for its contents.  In each frame, every tile has a few cells
+ * changed and is copied (with its subwindow) to the virtual screen with
+ * wnoutrefresh, a floating window is overlaid on one of the tiles, and the
+ * screen is updated with one doupdate.
+ *
+ * For each number of windows, this reports the frame-rate, the time spent in
+ * wnoutrefresh and doupdate, the bytes written and the memory used per
+ * window.  Finally, it measures the rate at which overwrite and overlay copy
+ * cells between two screen-sized windows.  This uses the curses.h made by
+ * with-slcurses, for derwin and overlay.
+ */
+#define _XOPEN_SOURCE 600	/* for posix_openpt, etc. */
+
+#include <curses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <slstats.h>
+#include <bench.priv.h>
+
+typedef struct {
+    WINDOW *frame;		/* the tile, with its border */
+    WINDOW *inside;		/* subwindow for the tile's contents */
+} TILE;
+
+typedef struct {
+    int windows;
+    long frames;
+    double elapsed;
+    double update;		/* seconds in wnoutrefresh, per frame */
+    double copy;		/* seconds in overlay, per frame */
+    double p50;			/* doupdate latency percentiles */
+    double p99;
+    double max;
+    unsigned long bytes;
+    unsigned long memory;	/* bytes per window, computed */
+    long rss;			/* maximum resident size, Kb */
+} RESULT;
+
+static bool interrupted = FALSE;
+static BENCH bench;
+static double copy_rate[2];	/* cells/sec for overwrite and overlay */
+
+static void
+onsig(int n)
+{
+    (void) n;
+    interrupted = TRUE;
+}
+
+static long
+max_rss(void)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+	return 0;
+    return ru.ru_maxrss;
+}
+
+/*
+ * slcurses allocates the cells of a window, and an array of pointers to its
+ * rows.  A subwindow's rows point into its parent's cells.
+ */
+static unsigned long
+window_bytes(WINDOW *w, bool subwin)
+{
+    unsigned long result = sizeof(WINDOW);
+
+    result += w->nrows * sizeof(w->lines[0]);
+    if (!subwin)
+	result += w->nrows * w->ncols * sizeof(w->lines[0][0]);
+    return result;
+}
+
+/*
+ * Tile the screen with the given number of windows, returning the number
+ * created, or zero if they would be too small.
+ */
+static int
+make_tiles(TILE * tiles, int count, unsigned long *memory)
+{
+    int across = (int) ceil(sqrt((double) count));
+    int down = (count + across - 1) / across;
+    int high = LINES / down;
+    int wide = COLS / across;
+    int n;
+
+    *memory = 0;
+    if (high < 3 || wide < 3)
+	return 0;
+
+    for (n = 0; n < count; ++n) {
+	int y = (n / across) * high;
+	int x = (n % across) * wide;
+
+	tiles[n].frame = newwin(high, wide, y, x);
+	tiles[n].inside = derwin(tiles[n].frame, high - 2, wide - 2, 1, 1);
+	if (tiles[n].frame == 0 || tiles[n].inside == 0)
+	    return 0;
+	box(tiles[n].frame, 0, 0);
+	*memory += window_bytes(tiles[n].frame, FALSE);
+	*memory += window_bytes(tiles[n].inside, TRUE);
+    }
+    *memory /= (unsigned long) count;
+    return count;
+}
+
+static void
+free_tiles(TILE * tiles, int count)
+{
+    int n;
+
+    for (n = 0; n < count; ++n) {
+	if (tiles[n].inside != 0)
+	    delwin(tiles[n].inside);
+	if (tiles[n].frame != 0)
+	    delwin(tiles[n].frame);
+	tiles[n].inside = 0;
+	tiles[n].frame = 0;
+    }
+}
+
+static void
+run_frames(RESULT * result, TILE * tiles, WINDOW *floating,
+	   long frames, int cells)
+{
+    unsigned long bytes = SLtt_Num_Chars_Output;
+    double started = bench_now();
+    double update = 0.0;
+    double copy = 0.0;
+    long frame;
+    int n, k;
+
+    bench_reset(&bench);
+    for (frame = 0; frame < frames && !interrupted; ++frame) {
+	double before;
+
+	for (n = 0; n < result->windows; ++n) {
+	    WINDOW *w = tiles[n].inside;
+	    for (k = 0; k < cells; ++k) {
+		int y = (int) (bench_ranf() * w->nrows);
+		int x = (int) (bench_ranf() * w->ncols);
+		int ch = 'a' + (int) (bench_ranf() * 26);
+		mvwaddch(w, y, x, (chtype) ch);
+	    }
+	}
+
+	before = bench_now();
+	overlay(floating, tiles[frame % result->windows].frame);
+	copy += bench_now() - before;
+
+	before = bench_now();
+	for (n = 0; n < result->windows; ++n) {
+	    wnoutrefresh(tiles[n].frame);
+	    wnoutrefresh(tiles[n].inside);
+	}
+	update += bench_now() - before;
+
+	before = bench_now();
+	doupdate();
+	bench_time(&bench, bench_now() - before);
+    }
+
+    result->frames = frame;
+    result->elapsed = bench_now() - started;
+    if (frame != 0) {
+	result->update = update / (double) frame;
+	result->copy = copy / (double) frame;
+    }
+    result->p50 = bench_percentile(&bench, 50.0);
+    result->p99 = bench_percentile(&bench, 99.0);
+    result->max = bench_percentile(&bench, 100.0);
+    result->bytes = SLtt_Num_Chars_Output - bytes;
+    result->rss = max_rss();
+}
+
+/*
+ * Copy a screen-sized window, in which one cell in three is blank, to another
+ * using overwrite and overlay.
+ */
+static void
+run_copies(long count)
+{
+    WINDOW *src = newwin(LINES, COLS, 0, 0);
+    WINDOW *dst = newwin(LINES, COLS, 0, 0);
+    int mode;
+    int y, x;
+
+    if (src == 0 || dst == 0)
+	return;
+    for (y = 0; y < LINES; ++y) {
+	for (x = 0; x < COLS; ++x) {
+	    mvwaddch(src, y, x, (chtype) (((y + x) % 3) ? ('a' + x % 26) : ' '));
+	}
+    }
+    for (mode = 0; mode < 2; ++mode) {
+	double started = bench_now();
+	double elapsed;
+	long n;
+
+	for (n = 0; n < count && !interrupted; ++n) {
+	    if (mode)
+		overlay(src, dst);
+	    else
+		overwrite(src, dst);
+	}
+	elapsed = bench_now() - started;
+	if (elapsed > 0.0)
+	    copy_rate[mode] = ((double) n * LINES * COLS) / elapsed;
+    }
+    delwin(dst);
+    delwin(src);
+}
+
+static void
+usage(void)
+{
+    static const char *msg[] =
+    {
+	"Usage: windows_slcurses [options]"
+	,""
+	,"Options:"
+	," -c cells  cells changed in each window per frame (default: 4)"
+	," -f count  frames for each number of windows (default: 200)"
+	," -n count  maximum number of windows (default: 64)"
+	," -p        write to a pseudo-terminal rather than the terminal"
+	," -s seed   seed the random-number generator (default: 1)"
+    };
+    size_t n;
+    for (n = 0; n < sizeof(msg) / sizeof(msg[0]); n++)
+	fprintf(stderr, "%s\n", msg[n]);
+    exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char *argv[])
+{
+    TILE *tiles;
+    RESULT *results;
+    WINDOW *floating;
+    int max_windows = 64;
+    int num_results = 0;
+    int cells = 4;
+    long frames = 200;
+    unsigned seed = 1;
+    bool use_pty = FALSE;
+    int count;
+    int ch;
+    int n;
+
+    while ((ch = getopt(argc, argv, "c:f:n:ps:")) != -1) {
+	switch (ch) {
+	case 'c':
+	    cells = atoi(optarg);
+	    break;
+	case 'f':
+	    frames = atol(optarg);
+	    break;
+	case 'n':
+	    max_windows = atoi(optarg);
+	    break;
+	case 'p':
+	    use_pty = TRUE;
+	    break;
+	case 's':
+	    seed = (unsigned) strtoul(optarg, (char **) 0, 0);
+	    break;
+	default:
+	    usage();
+	    /* NOTREACHED */
+	}
+    }
+    if (optind < argc || max_windows < 1 || frames < 1 || cells < 0)
+	usage();
+
+    bench_srand(seed);
+    tiles = calloc((size_t) max_windows, sizeof(TILE));
+    results = calloc((size_t) max_windows, sizeof(RESULT));
+    if (tiles == 0 || results == 0) {
+	fprintf(stderr, "cannot allocate windows\n");
+	exit(EXIT_FAILURE);
+    }
+
+    if (use_pty && bench_open_pty(&bench, 60, 200) < 0) {
+	perror("pseudo-terminal");
+	exit(EXIT_FAILURE);
+    }
+
+    initscr();
+    signal(SIGINT, onsig);
+    signal(SIGQUIT, onsig);
+    signal(SIGTERM, onsig);
+
+    floating = newwin(LINES / 4 + 1, COLS / 4 + 1, 0, 0);
+    if (floating == 0) {
+	endwin();
+	fprintf(stderr, "cannot create window\n");
+	exit(EXIT_FAILURE);
+    }
+    for (n = 0; n < (LINES / 4) * (COLS / 4); n += 3)
+	mvwaddch(floating, n / (COLS / 4), n % (COLS / 4), (chtype) '#');
+
+    /* double the count each pass, ending with max_windows */
+    for (count = 1;
+	 count <= max_windows && num_results < max_windows && !interrupted;
+	 count = ((count < max_windows)
+		  ? ((count * 2 < max_windows) ? count * 2 : max_windows)
+		  : max_windows + 1)) {
+	RESULT *result = &results[num_results];
+
+	erase();
+	wnoutrefresh(stdscr);
+	result->windows = make_tiles(tiles, count, &result->memory);
+	if (result->windows == 0) {
+	    free_tiles(tiles, count);
+	    break;
+	}
+	run_frames(result, tiles, floating, frames, cells);
+	free_tiles(tiles, count);
+	++num_results;
+    }
+
+    delwin(floating);
+    if (!interrupted)
+	run_copies(frames);
+    endwin();
+    if (use_pty)
+	bench_close_pty(&bench);
+
+    for (n = 0; n < num_results; ++n) {
+	RESULT *r = &results[n];
+	double frames_done = (double) (r->frames ? r->frames : 1);
+	double fps = 0.0;
+	double cps = 0.0;
+
+	/* an interrupted run may not have finished a frame */
+	if (r->elapsed > 0.0) {
+	    fps = (double) r->frames / r->elapsed;
+	    cps = (double) (r->frames * r->windows * cells) / r->elapsed;
+	}
+
+	printf("windows_slcurses windows=%d frames=%ld fps=%.1f"
+	       " cells_per_sec=%.0f update_us=%.1f overlay_us=%.1f"
+	       " doupdate_p50_us=%.1f doupdate_p99_us=%.1f doupdate_max_us=%.1f"
+	       " bytes_per_frame=%.1f bytes_per_window=%lu rss_kb=%ld\n",
+	       r->windows,
+	       r->frames,
+	       fps,
+	       cps,
+	       r->update * 1e6,
+	       r->copy * 1e6,
+	       r->p50 * 1e6,
+	       r->p99 * 1e6,
+	       r->max * 1e6,
+	       (double) r->bytes / frames_done,
+	       r->memory,
+	       r->rss);
+    }
+    printf("windows_slcurses copy=overwrite cells_per_sec=%.0f\n",
+	   copy_rate[0]);
+    printf("windows_slcurses copy=overlay cells_per_sec=%.0f\n",
+	   copy_rate[1]);
+    free(tiles);
+    free(results);
+    exit(EXIT_SUCCESS);
+}